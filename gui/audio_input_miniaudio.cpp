@@ -0,0 +1,149 @@
+#include "miniaudio.h"
+#include "audio_input_miniaudio.h"
+#include "utils/log.h"
+#include "utils/pcm.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+static constexpr ma_uint32 SAMPLE_RATE = 48000;
+static constexpr ma_uint32 CHANNELS = 2;
+static constexpr ma_uint32 RING_BUFFER_FRAMES = 2048; // ~43ms at 48kHz
+// Input older than this is skipped so latency stays bounded when the capture
+// device runs ahead of the guest
+static constexpr ma_uint32 MAX_LATENCY_FRAMES = 512; // ~11ms
+static constexpr ma_uint32 PERIOD_FRAMES = 128;
+static constexpr size_t CONVERT_FRAMES = 256;
+
+MiniaudioInput::MiniaudioInput()
+    : device_(nullptr), ringBuffer_(nullptr), resampler_(RING_BUFFER_FRAMES), convertBuffer_(CONVERT_FRAMES * CHANNELS) {
+
+    auto* rb = new ma_pcm_rb;
+    auto* dev = new ma_device;
+
+    // The capture callback (producer) and the CPU thread (consumer) share a
+    // lock-free single-producer/single-consumer ring (float32, stereo)
+    ma_result result = ma_pcm_rb_init(ma_format_f32, CHANNELS, RING_BUFFER_FRAMES, nullptr, nullptr, rb);
+    if (result != MA_SUCCESS) {
+        LogError("Failed to initialize audio input ring buffer: %d", result);
+        delete rb;
+        delete dev;
+        return;
+    }
+
+    ma_device_config config = ma_device_config_init(ma_device_type_capture);
+    config.capture.format = ma_format_f32;
+    config.capture.channels = CHANNELS;
+    config.sampleRate = SAMPLE_RATE;
+    config.periodSizeInFrames = PERIOD_FRAMES; // ~2.7ms
+    config.dataCallback = reinterpret_cast<ma_device_data_proc>(DataCallback);
+    config.pUserData = rb;
+
+    result = ma_device_init(nullptr, &config, dev);
+    if (result != MA_SUCCESS) {
+        LogError("Failed to initialize audio capture device: %d", result);
+        ma_pcm_rb_uninit(rb);
+        delete rb;
+        delete dev;
+        return;
+    }
+
+    result = ma_device_start(dev);
+    if (result != MA_SUCCESS) {
+        LogError("Failed to start audio capture device: %d", result);
+        ma_device_uninit(dev);
+        ma_pcm_rb_uninit(rb);
+        delete rb;
+        delete dev;
+        return;
+    }
+
+    device_ = dev;
+    ringBuffer_ = rb;
+    active_.store(true);
+    LogInfo("Audio input initialized: %dHz, %dch, period=%d frames",
+            SAMPLE_RATE, CHANNELS, config.periodSizeInFrames);
+}
+
+MiniaudioInput::~MiniaudioInput() {
+    if (device_) {
+        ma_device_uninit(static_cast<ma_device*>(device_));
+        delete static_cast<ma_device*>(device_);
+    }
+    if (ringBuffer_) {
+        ma_pcm_rb_uninit(static_cast<ma_pcm_rb*>(ringBuffer_));
+        delete static_cast<ma_pcm_rb*>(ringBuffer_);
+    }
+}
+
+void MiniaudioInput::DataCallback(void* pDevice, void* pOutput, const void* pInput, unsigned int frameCount) {
+    (void)pOutput;
+
+    ma_device* dev = static_cast<ma_device*>(pDevice);
+    ma_pcm_rb* rb = static_cast<ma_pcm_rb*>(dev->pUserData);
+    const float* input = static_cast<const float*>(pInput);
+
+    ma_uint32 framesRemaining = frameCount;
+    while (framesRemaining > 0) {
+        void* writeBuffer;
+        ma_uint32 framesToWrite = framesRemaining;
+        ma_result result = ma_pcm_rb_acquire_write(rb, &framesToWrite, &writeBuffer);
+        if (result != MA_SUCCESS || framesToWrite == 0) {
+            break; // Ring full: the CPU thread is not draining, drop the input
+        }
+        memcpy(writeBuffer, input, framesToWrite * CHANNELS * sizeof(float));
+        ma_pcm_rb_commit_write(rb, framesToWrite);
+        input += framesToWrite * CHANNELS;
+        framesRemaining -= framesToWrite;
+    }
+}
+
+size_t MiniaudioInput::ReadSamples(void* data, size_t samples, int channels, int bitsPerSample, uint32_t sampleRate) {
+    uint8_t* dest = static_cast<uint8_t*>(data);
+    size_t frameSize = (bitsPerSample > 16 ? 4 : 2) * channels;
+    size_t done = 0;
+
+    if (active_.load()) {
+        ma_pcm_rb* rb = static_cast<ma_pcm_rb*>(ringBuffer_);
+        // Device frames per SPORT frame. The resampler is only topped up with
+        // what the request still needs, so it adds no latency of its own.
+        double step = static_cast<double>(SAMPLE_RATE) / sampleRate;
+        if (sampleRate != outputRate_) {
+            outputRate_ = sampleRate;
+            resampler_ = CubicResampler(RING_BUFFER_FRAMES + static_cast<size_t>(std::ceil(step)) + 8);
+        }
+
+        // Skip stale input beyond the latency bound
+        ma_uint32 queued = ma_pcm_rb_available_read(rb);
+        size_t needed = static_cast<size_t>(std::ceil(samples * step));
+        ma_uint32 keep = std::max<ma_uint32>(MAX_LATENCY_FRAMES, static_cast<ma_uint32>(std::min<size_t>(needed, RING_BUFFER_FRAMES)));
+        if (queued > keep) {
+            ma_pcm_rb_seek_read(rb, queued - keep);
+        }
+
+        FloatToPCMFn convert = SelectFloatToPCM(channels, bitsPerSample);
+        while (done < samples) {
+            size_t available = resampler_.Available(step);
+            if (available == 0) {
+                void* readBuffer;
+                size_t wanted = static_cast<size_t>(std::ceil((samples - done) * step)) + 4;
+                ma_uint32 framesToRead = static_cast<ma_uint32>(std::min<size_t>(wanted, RING_BUFFER_FRAMES));
+                ma_result result = ma_pcm_rb_acquire_read(rb, &framesToRead, &readBuffer);
+                if (result != MA_SUCCESS || framesToRead == 0) {
+                    break;
+                }
+                resampler_.Push(static_cast<const float*>(readBuffer), framesToRead);
+                ma_pcm_rb_commit_read(rb, framesToRead);
+                continue;
+            }
+            size_t frames = std::min({samples - done, available, CONVERT_FRAMES});
+            frames = resampler_.Pull(convertBuffer_.data(), frames, step);
+            convert(dest + done * frameSize, convertBuffer_.data(), frames);
+            done += frames;
+        }
+    }
+
+    // Underrun: pad with silence rather than stalling the guest's sample clock
+    memset(dest + done * frameSize, 0, (samples - done) * frameSize);
+    return samples;
+}
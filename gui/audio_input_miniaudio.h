@@ -0,0 +1,28 @@
+#pragma once
+
+#include "peripheral/audio_input.h"
+#include "utils/resampler.h"
+#include <atomic>
+#include <vector>
+
+class MiniaudioInput : public AudioInput {
+public:
+    MiniaudioInput();
+    ~MiniaudioInput() override;
+
+    bool IsActive() const { return active_.load(); }
+    size_t ReadSamples(void* data, size_t samples, int channels, int bitsPerSample, uint32_t sampleRate) override;
+
+private:
+    static void DataCallback(void* pDevice, void* pOutput, const void* pInput, unsigned int frameCount);
+
+    void* device_;      // ma_device*
+    void* ringBuffer_;  // ma_pcm_rb*
+    std::atomic<bool> active_{false};
+
+    // Resampling from SAMPLE_RATE to the SPORT rate. Only touched on the
+    // CPU thread.
+    CubicResampler resampler_;
+    uint32_t outputRate_ = 0; // rate the resampler was sized for
+    std::vector<float> convertBuffer_;
+};
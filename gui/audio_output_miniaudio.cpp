@@ -2,15 +2,33 @@
 #include "miniaudio.h"
 #include "audio_output_miniaudio.h"
 #include "utils/log.h"
+#include "utils/pcm.h"
+#include <cmath>
 #include <cstring>
 #include <algorithm>
 
 static constexpr ma_uint32 SAMPLE_RATE = 48000;
 static constexpr ma_uint32 CHANNELS = 2;
 static constexpr ma_uint32 RING_BUFFER_FRAMES = 4096; // ~85ms at 48kHz
+static constexpr ma_uint32 PERIOD_FRAMES = 256;       // ~5.3ms low-latency period
+// Longest a queue-paced wait sleeps without rechecking the fill
+static constexpr auto DRAIN_WAIT = std::chrono::microseconds(1'000'000 * PERIOD_FRAMES / SAMPLE_RATE);
+
+// Rate controller: hold the ring at TARGET_FILL_FRAMES by resampling at most
+// MAX_RATE_DEVIATION away from the SPORT rate to SAMPLE_RATE. The fill is
+// smoothed first because the device drains it in whole periods.
+static constexpr double TARGET_FILL_FRAMES = RING_BUFFER_FRAMES / 2; // ~43ms
+static constexpr double MAX_RATE_DEVIATION = 0.05;
+static constexpr double FILL_SMOOTHING = 0.01;
+static constexpr double RATE_GAIN_P = 0.02;
+static constexpr double RATE_GAIN_I = 0.00002;
+static constexpr size_t CONVERT_FRAMES = 1024;
+// Weight of each callback in the mean jitter
+static constexpr double JITTER_SMOOTHING = 1.0 / 16;
 
 MiniaudioOutput::MiniaudioOutput()
-    : device_(nullptr), ringBuffer_(nullptr) {
+    : device_(nullptr), ringBuffer_(nullptr), resampler_(RING_BUFFER_FRAMES),
+      convertBuffer_(CONVERT_FRAMES * CHANNELS), fillAverage_(TARGET_FILL_FRAMES) {
 
     auto* rb = new ma_pcm_rb;
     auto* dev = new ma_device;
@@ -23,15 +41,16 @@ MiniaudioOutput::MiniaudioOutput()
         delete dev;
         return;
     }
+    ringBuffer_ = rb; // read by DataCallback from the first callback on
 
     // Configure the playback device
     ma_device_config config = ma_device_config_init(ma_device_type_playback);
     config.playback.format = ma_format_f32;
     config.playback.channels = CHANNELS;
     config.sampleRate = SAMPLE_RATE;
-    config.periodSizeInFrames = 256; // ~5.3ms low-latency period
+    config.periodSizeInFrames = PERIOD_FRAMES;
     config.dataCallback = reinterpret_cast<ma_device_data_proc>(DataCallback);
-    config.pUserData = rb;
+    config.pUserData = this;
 
     result = ma_device_init(nullptr, &config, dev);
     if (result != MA_SUCCESS) {
@@ -39,6 +58,7 @@ MiniaudioOutput::MiniaudioOutput()
         ma_pcm_rb_uninit(rb);
         delete rb;
         delete dev;
+        ringBuffer_ = nullptr;
         return;
     }
 
@@ -49,11 +69,11 @@ MiniaudioOutput::MiniaudioOutput()
         ma_pcm_rb_uninit(rb);
         delete rb;
         delete dev;
+        ringBuffer_ = nullptr;
         return;
     }
 
     device_ = dev;
-    ringBuffer_ = rb;
     active_.store(true);
     LogInfo("Audio output initialized: %dHz, %dch, period=%d frames",
             SAMPLE_RATE, CHANNELS, config.periodSizeInFrames);
@@ -74,7 +94,8 @@ void MiniaudioOutput::DataCallback(void* pDevice, void* pOutput, const void* pIn
     (void)pInput;
 
     ma_device* dev = static_cast<ma_device*>(pDevice);
-    ma_pcm_rb* rb = static_cast<ma_pcm_rb*>(dev->pUserData);
+    auto* self = static_cast<MiniaudioOutput*>(dev->pUserData);
+    ma_pcm_rb* rb = static_cast<ma_pcm_rb*>(self->ringBuffer_);
     float* output = static_cast<float*>(pOutput);
 
     ma_uint32 framesRemaining = frameCount;
@@ -98,77 +119,127 @@ void MiniaudioOutput::DataCallback(void* pDevice, void* pOutput, const void* pIn
     // Fill remaining with silence (underrun)
     if (framesRemaining > 0) {
         memset(output + framesWritten * CHANNELS, 0, framesRemaining * CHANNELS * sizeof(float));
+        self->underrunFrames_.fetch_add(framesRemaining, std::memory_order_relaxed);
     }
+    self->TrackCallback(frameCount);
+
+    // Never blocks on the waiter: a notification lost while it holds the
+    // mutex only costs it one DRAIN_WAIT
+    self->drains_.fetch_add(1, std::memory_order_release);
+    if (self->drainMutex_.try_lock()) {
+        self->drained_.notify_one();
+        self->drainMutex_.unlock();
+    }
+}
+
+// Measures how far the time since the previous callback is from the period
+// the device asked for, i.e. how unevenly the ring buffer is drained.
+void MiniaudioOutput::TrackCallback(unsigned int frameCount) {
+    auto now = std::chrono::steady_clock::now();
+    if (callbacks_.fetch_add(1, std::memory_order_relaxed) > 0) {
+        double elapsed = std::chrono::duration<double, std::micro>(now - lastCallback_).count();
+        double jitter = std::abs(elapsed - frameCount * 1e6 / SAMPLE_RATE);
+        jitterAverage_ += (jitter - jitterAverage_) * JITTER_SMOOTHING;
+        jitterMicros_.store(static_cast<uint64_t>(jitterAverage_), std::memory_order_relaxed);
+        if (jitter > maxJitterMicros_.load(std::memory_order_relaxed)) {
+            maxJitterMicros_.store(static_cast<uint64_t>(jitter), std::memory_order_relaxed);
+        }
+    }
+    lastCallback_ = now;
+}
+
+size_t MiniaudioOutput::QueuedFrames() const {
+    if (!active_.load()) {
+        return 0;
+    }
+    return ma_pcm_rb_available_read(static_cast<ma_pcm_rb*>(ringBuffer_));
+}
+
+size_t MiniaudioOutput::TargetQueuedFrames() const {
+    return static_cast<size_t>(TARGET_FILL_FRAMES);
+}
+
+void MiniaudioOutput::WaitQueuedBelow(size_t frames, std::chrono::steady_clock::time_point deadline) {
+    std::unique_lock<std::mutex> lock(drainMutex_);
+    while (QueuedFrames() >= frames) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            break;
+        }
+        uint64_t drains = drains_.load(std::memory_order_acquire);
+        drained_.wait_for(lock, std::min<std::chrono::steady_clock::duration>(DRAIN_WAIT, deadline - now),
+                          [&]() { return drains_.load(std::memory_order_acquire) != drains; });
+    }
+}
+
+AudioTelemetry MiniaudioOutput::Telemetry() const {
+    AudioTelemetry telemetry;
+    telemetry.framesWritten = framesWritten_.load(std::memory_order_relaxed);
+    telemetry.framesDropped = framesDropped_.load(std::memory_order_relaxed);
+    telemetry.underrunFrames = underrunFrames_.load(std::memory_order_relaxed);
+    telemetry.queuedFrames = QueuedFrames();
+    telemetry.callbacks = callbacks_.load(std::memory_order_relaxed);
+    telemetry.callbackJitterMicros = jitterMicros_.load(std::memory_order_relaxed);
+    telemetry.maxCallbackJitterMicros = maxJitterMicros_.load(std::memory_order_relaxed);
+    return telemetry;
 }
 
-void MiniaudioOutput::WriteSamples(const void* data, size_t samples, int channels, int bitsPerSample) {
+// Returns the resampler step (input frames per output frame) from input at
+// `sampleRate` for the current ring buffer fill: above target the input is
+// consumed faster, below it slower.
+double MiniaudioOutput::UpdateRate(size_t fill, uint32_t sampleRate) {
+    double nominal = static_cast<double>(sampleRate) / SAMPLE_RATE;
+    if (queuePaced_.load(std::memory_order_relaxed)) {
+        // The pacer owns the fill; start over from it once pacing stops
+        fillAverage_ = fill;
+        rateIntegral_ = 0.0;
+        return nominal;
+    }
+    fillAverage_ += (fill - fillAverage_) * FILL_SMOOTHING;
+    double error = (fillAverage_ - TARGET_FILL_FRAMES) / TARGET_FILL_FRAMES;
+    rateIntegral_ = std::clamp(rateIntegral_ + error * RATE_GAIN_I, -MAX_RATE_DEVIATION, MAX_RATE_DEVIATION);
+    double correction = std::clamp(error * RATE_GAIN_P + rateIntegral_, -MAX_RATE_DEVIATION, MAX_RATE_DEVIATION);
+    return nominal * (1.0 + correction);
+}
+
+void MiniaudioOutput::WriteSamples(const void* data, size_t samples, int channels, int bitsPerSample,
+                                   uint32_t sampleRate) {
     if (!active_.load() || samples == 0) {
         return;
     }
 
     ma_pcm_rb* rb = static_cast<ma_pcm_rb*>(ringBuffer_);
 
-    // Convert input PCM to float32 stereo and push to ring buffer.
-    // Process in chunks to avoid large stack allocations.
-    constexpr size_t CHUNK_FRAMES = 256;
-    float chunk[CHUNK_FRAMES * CHANNELS];
-
+    // Convert input PCM to float32 stereo and queue it in the resampler
+    PCMToFloatFn convert = SelectPCMToFloat(channels, bitsPerSample);
     const uint8_t* src = static_cast<const uint8_t*>(data);
-    int wordSize = bitsPerSample > 16 ? 4 : 2;
-    size_t srcStride = wordSize * channels;
-
-    size_t framesRemaining = samples;
-    while (framesRemaining > 0) {
-        size_t framesToProcess = std::min(framesRemaining, CHUNK_FRAMES);
-
-        // Convert to float32 stereo
-        for (size_t i = 0; i < framesToProcess; i++) {
-            float left = 0.0f, right = 0.0f;
-
-            if (bitsPerSample <= 16) {
-                // 16-bit signed integer
-                int16_t sample;
-                memcpy(&sample, src + i * srcStride, sizeof(int16_t));
-                left = static_cast<float>(sample) / 32768.0f;
-
-                if (channels >= 2) {
-                    memcpy(&sample, src + i * srcStride + 2, sizeof(int16_t));
-                    right = static_cast<float>(sample) / 32768.0f;
-                } else {
-                    right = left;
-                }
-            } else {
-                // 24-bit packed in 32-bit words
-                int32_t sample;
-                memcpy(&sample, src + i * srcStride, sizeof(int32_t));
-                // Sign-extend from 24-bit
-                sample = (sample << 8) >> 8;
-                left = static_cast<float>(sample) / 8388608.0f;
-
-                if (channels >= 2) {
-                    memcpy(&sample, src + i * srcStride + 4, sizeof(int32_t));
-                    sample = (sample << 8) >> 8;
-                    right = static_cast<float>(sample) / 8388608.0f;
-                } else {
-                    right = left;
-                }
-            }
-
-            chunk[i * CHANNELS] = left;
-            chunk[i * CHANNELS + 1] = right;
+    size_t srcStride = (bitsPerSample > 16 ? 4 : 2) * channels;
+    for (size_t done = 0; done < samples;) {
+        size_t frames = std::min(samples - done, CONVERT_FRAMES);
+        convert(convertBuffer_.data(), src + done * srcStride, frames);
+        // Overflow drops the oldest input
+        size_t dropped = resampler_.Push(convertBuffer_.data(), frames);
+        if (dropped) {
+            framesDropped_.fetch_add(dropped, std::memory_order_relaxed);
         }
+        done += frames;
+    }
+    framesWritten_.fetch_add(samples, std::memory_order_relaxed);
 
-        // Push to ring buffer
-        ma_uint32 framesToWrite = static_cast<ma_uint32>(framesToProcess);
+    // Resample straight into the ring buffer. The writable region may wrap,
+    // so this takes at most two passes; whatever does not fit stays queued.
+    double step = UpdateRate(ma_pcm_rb_available_read(rb), sampleRate);
+    while (size_t available = resampler_.Available(step)) {
+        ma_uint32 framesToWrite = static_cast<ma_uint32>(std::min<size_t>(available, RING_BUFFER_FRAMES));
         void* writeBuffer;
         ma_result result = ma_pcm_rb_acquire_write(rb, &framesToWrite, &writeBuffer);
-        if (result == MA_SUCCESS && framesToWrite > 0) {
-            memcpy(writeBuffer, chunk, framesToWrite * CHANNELS * sizeof(float));
-            ma_pcm_rb_commit_write(rb, framesToWrite);
+        if (result != MA_SUCCESS || framesToWrite == 0) {
+            break;
+        }
+        size_t produced = resampler_.Pull(static_cast<float*>(writeBuffer), framesToWrite, step);
+        ma_pcm_rb_commit_write(rb, static_cast<ma_uint32>(produced));
+        if (produced == 0) {
+            break;
         }
-        // If ring buffer is full, we drop samples (acceptable for emulator)
-
-        framesRemaining -= framesToProcess;
-        src += framesToProcess * srcStride;
     }
 }
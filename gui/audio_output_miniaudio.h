@@ -1,19 +1,58 @@
 #pragma once
 
 #include "peripheral/audio_output.h"
+#include "utils/resampler.h"
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
 
 class MiniaudioOutput : public AudioOutput {
 public:
     MiniaudioOutput();
     ~MiniaudioOutput() override;
 
-    void WriteSamples(const void* data, size_t samples, int channels, int bitsPerSample) override;
+    void WriteSamples(const void* data, size_t samples, int channels, int bitsPerSample, uint32_t sampleRate) override;
+    size_t QueuedFrames() const override;
+    size_t TargetQueuedFrames() const override;
+    void WaitQueuedBelow(size_t frames, std::chrono::steady_clock::time_point deadline) override;
+    void SetQueuePaced(bool paced) override { queuePaced_.store(paced); }
+    AudioTelemetry Telemetry() const override;
 
 private:
     static void DataCallback(void* pDevice, void* pOutput, const void* pInput, unsigned int frameCount);
+    void TrackCallback(unsigned int frameCount);
+    double UpdateRate(size_t fill, uint32_t sampleRate);
 
     void* device_;      // ma_device*
     void* ringBuffer_;  // ma_pcm_rb*
     std::atomic<bool> active_{false};
+
+    // Drift compensation: the resampler step follows the ring buffer fill so
+    // that it settles at the target latency. Only touched on the CPU thread.
+    // Off while the CPU thread is paced to the fill, which then already
+    // follows the device clock.
+    CubicResampler resampler_;
+    std::vector<float> convertBuffer_;
+    double fillAverage_;
+    double rateIntegral_ = 0.0;
+    std::atomic<bool> queuePaced_{false};
+
+    // Device callbacks so far, and a wakeup for WaitQueuedBelow that the
+    // callback sends only if it gets the mutex without waiting
+    std::atomic<uint64_t> drains_{0};
+    std::mutex drainMutex_;
+    std::condition_variable drained_;
+
+    // Telemetry. The CPU thread counts frames in and out of the resampler,
+    // the device callback counts underruns and times itself.
+    std::atomic<uint64_t> framesWritten_{0};
+    std::atomic<uint64_t> framesDropped_{0};
+    std::atomic<uint64_t> underrunFrames_{0};
+    std::atomic<uint64_t> callbacks_{0};
+    std::atomic<uint64_t> jitterMicros_{0};
+    std::atomic<uint64_t> maxJitterMicros_{0};
+    std::chrono::steady_clock::time_point lastCallback_; // device callback only
+    double jitterAverage_ = 0.0;                         // device callback only
 };
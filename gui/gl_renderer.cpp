@@ -0,0 +1,302 @@
+// Core profile entry points are linked directly from libGL
+#define GL_GLEXT_PROTOTYPES
+#include "gl_renderer.h"
+#include "utils/log.h"
+#include <GL/glext.h>
+#include <cmath>
+#include <cstring>
+
+static const char* VERTEX_SHADER = R"(
+#version 330 core
+layout(location = 0) in vec2 corner;
+uniform vec2 windowSize;
+out vec2 windowPos;
+void main() {
+    windowPos = corner * windowSize;
+    gl_Position = vec4(corner.x * 2.0 - 1.0, 1.0 - corner.y * 2.0, 0.0, 1.0);
+}
+)";
+
+// Background blended over black as before, with the display sampled where
+// the inverse-rotated window position falls inside its quad.
+static const char* FRAGMENT_SHADER = R"(
+#version 330 core
+in vec2 windowPos;
+uniform vec2 windowSize;
+uniform sampler2D background;
+uniform sampler2D display;
+uniform bool hasDisplay;
+uniform vec2 displayCenter;
+uniform vec2 displaySize;
+uniform mat2 displayRotation;
+out vec4 color;
+void main() {
+    vec4 bg = texture(background, windowPos / windowSize);
+    color = vec4(bg.rgb * bg.a, 1.0);
+    vec2 uv = displayRotation * (windowPos - displayCenter) / displaySize + 0.5;
+    if (hasDisplay && all(greaterThanEqual(uv, vec2(0.0))) && all(lessThan(uv, vec2(1.0)))) {
+        color = vec4(texture(display, uv).rgb, 1.0);
+    }
+}
+)";
+
+// Longest wait for the GPU to release an upload slot
+static constexpr GLuint64 UPLOAD_FENCE_TIMEOUT_NS = 100'000'000;
+
+// Packs `rows` rows of `rowBytes` from a buffer with `stride` byte rows
+static void CopyRows(uint8_t* dest, const uint8_t* source, int rows, size_t rowBytes, size_t stride)
+{
+    if (stride == rowBytes) {
+        memcpy(dest, source, rows * rowBytes);
+        return;
+    }
+    for (int row = 0; row < rows; row++) {
+        memcpy(dest + row * rowBytes, source + row * stride, rowBytes);
+    }
+}
+
+static GLuint CompileShader(GLenum type, const char* source) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+    GLint ok = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        LogError("Shader compilation failed: %s", log);
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+GLRenderer::~GLRenderer() {
+    ReleaseUploadBuffer();
+    if (displayTexture_) glDeleteTextures(1, &displayTexture_);
+    if (backgroundTexture_) glDeleteTextures(1, &backgroundTexture_);
+    if (vertexBuffer_) glDeleteBuffers(1, &vertexBuffer_);
+    if (vertexArray_) glDeleteVertexArrays(1, &vertexArray_);
+    if (program_) glDeleteProgram(program_);
+}
+
+bool GLRenderer::Initialize() {
+    GLuint vertexShader = CompileShader(GL_VERTEX_SHADER, VERTEX_SHADER);
+    GLuint fragmentShader = CompileShader(GL_FRAGMENT_SHADER, FRAGMENT_SHADER);
+    if (!vertexShader || !fragmentShader) {
+        return false;
+    }
+    program_ = glCreateProgram();
+    glAttachShader(program_, vertexShader);
+    glAttachShader(program_, fragmentShader);
+    glLinkProgram(program_);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+    GLint ok = GL_FALSE;
+    glGetProgramiv(program_, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        char log[1024];
+        glGetProgramInfoLog(program_, sizeof(log), nullptr, log);
+        LogError("Shader link failed: %s", log);
+        return false;
+    }
+
+    glUseProgram(program_);
+    glUniform1i(glGetUniformLocation(program_, "background"), 0);
+    glUniform1i(glGetUniformLocation(program_, "display"), 1);
+    windowSizeLocation_ = glGetUniformLocation(program_, "windowSize");
+    displayCenterLocation_ = glGetUniformLocation(program_, "displayCenter");
+    displaySizeLocation_ = glGetUniformLocation(program_, "displaySize");
+    displayRotationLocation_ = glGetUniformLocation(program_, "displayRotation");
+    hasDisplayLocation_ = glGetUniformLocation(program_, "hasDisplay");
+
+    // One window-covering quad; the vertex shader scales it to the window
+    static const float corners[] = {0, 0, 1, 0, 0, 1, 1, 1};
+    glGenVertexArrays(1, &vertexArray_);
+    glBindVertexArray(vertexArray_);
+    glGenBuffers(1, &vertexBuffer_);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer_);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), nullptr);
+    glEnableVertexAttribArray(0);
+
+    persistentUpload_ = glfwExtensionSupported("GL_ARB_buffer_storage");
+    LogInfo("Renderer: %s, %s uploads", reinterpret_cast<const char*>(glGetString(GL_VERSION)),
+            persistentUpload_ ? "persistent mapped" : "orphaned");
+    return true;
+}
+
+void GLRenderer::SetBackground(const uint8_t* rgba, int width, int height) {
+    if (!backgroundTexture_) {
+        glGenTextures(1, &backgroundTexture_);
+    }
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, backgroundTexture_);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+}
+
+void GLRenderer::CreateDisplayTexture(int width, int height) {
+    if (displayTexture_) {
+        glDeleteTextures(1, &displayTexture_);
+    }
+    glGenTextures(1, &displayTexture_);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, displayTexture_);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB565, width, height, 0, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, nullptr);
+    displayWidth_ = width;
+    displayHeight_ = height;
+
+    // Upload slots sized for whole frames
+    ReleaseUploadBuffer();
+    slotBytes_ = static_cast<size_t>(width) * height * sizeof(uint16_t);
+    glGenBuffers(1, &uploadBuffer_);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBuffer_);
+    if (persistentUpload_) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, slotBytes_ * UPLOAD_SLOTS, nullptr, flags);
+        uploadMapping_ = static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, slotBytes_ * UPLOAD_SLOTS, flags));
+        if (!uploadMapping_) {
+            LogWarn("Persistent upload buffer mapping failed, falling back to orphaning");
+            persistentUpload_ = false;
+            glDeleteBuffers(1, &uploadBuffer_);
+            glGenBuffers(1, &uploadBuffer_);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBuffer_);
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void GLRenderer::ReleaseUploadBuffer() {
+    for (auto& fence : fences_) {
+        if (fence) {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+    if (uploadBuffer_) {
+        if (uploadMapping_) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBuffer_);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            uploadMapping_ = nullptr;
+        }
+        glDeleteBuffers(1, &uploadBuffer_);
+        uploadBuffer_ = 0;
+    }
+}
+
+void GLRenderer::UploadFrame(const uint16_t* pixels, int width, int height, int top, int bottom, size_t stride) {
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+    if (width != displayWidth_ || height != displayHeight_ || !displayTexture_) {
+        CreateDisplayTexture(width, height);
+        top = 0;
+        bottom = height - 1;
+    }
+    if (bottom < top) {
+        return;
+    }
+    int rows = bottom - top + 1;
+    size_t rowBytes = static_cast<size_t>(width) * sizeof(uint16_t);
+    if (stride == 0) {
+        stride = rowBytes;
+    }
+    const uint8_t* source = reinterpret_cast<const uint8_t*>(pixels) + top * stride;
+    size_t bytes = rows * rowBytes;
+
+    // Stage the rows in the upload buffer; the texture update then reads
+    // from it on the GPU timeline instead of from client memory
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBuffer_);
+    const void* uploadSource = nullptr; // offset into the upload buffer
+    int rowLength = 0;
+    int slot = -1;
+    if (persistentUpload_) {
+        slot = FreeUploadSlot();
+        if (slot >= 0) {
+            slot_ = slot;
+            size_t offset = slot * slotBytes_;
+            CopyRows(uploadMapping_ + offset, source, rows, rowBytes, stride);
+            uploadSource = reinterpret_cast<const void*>(offset);
+        } else {
+            // The GPU still reads every slot: upload from the frame itself
+            // and let the driver copy it, rather than overwrite a slot
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            uploadSource = source;
+            rowLength = static_cast<int>(stride / sizeof(uint16_t));
+        }
+    } else {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, slotBytes_, nullptr, GL_STREAM_DRAW); // orphan
+        if (stride == rowBytes) {
+            glBufferSubData(GL_PIXEL_UNPACK_BUFFER, 0, bytes, source);
+        } else if (void* mapping = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT)) {
+            CopyRows(static_cast<uint8_t*>(mapping), source, rows, rowBytes, stride);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+    }
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, displayTexture_);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, rowLength);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, top, width, rows, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, uploadSource);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (slot >= 0) {
+        fences_[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+}
+
+// The next upload slot once the GPU is done with it, waiting for it up to
+// UPLOAD_FENCE_TIMEOUT_NS, else any other free slot, else -1
+int GLRenderer::FreeUploadSlot() {
+    for (int i = 1; i <= UPLOAD_SLOTS; i++) {
+        int slot = (slot_ + i) % UPLOAD_SLOTS;
+        if (GLsync fence = fences_[slot]) {
+            GLuint64 timeout = i == 1 ? UPLOAD_FENCE_TIMEOUT_NS : 0;
+            GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+                continue;
+            }
+            glDeleteSync(fence);
+            fences_[slot] = nullptr;
+        }
+        return slot;
+    }
+    return -1;
+}
+
+void GLRenderer::Draw(int viewportWidth, int viewportHeight, int windowWidth, int windowHeight,
+                      float centerX, float centerY, float width, float height, int rotation) {
+    glViewport(0, 0, viewportWidth, viewportHeight);
+    glUseProgram(program_);
+    glBindVertexArray(vertexArray_);
+
+    // Maps window offsets from the display center back into the unrotated
+    // quad (column-major)
+    float radians = rotation * static_cast<float>(M_PI) / 180.0f;
+    float c = std::cos(radians);
+    float s = std::sin(radians);
+    const float inverseRotation[] = {c, -s, s, c};
+
+    glUniform2f(windowSizeLocation_, windowWidth, windowHeight);
+    glUniform2f(displayCenterLocation_, centerX, centerY);
+    glUniform2f(displaySizeLocation_, width, height);
+    glUniformMatrix2fv(displayRotationLocation_, 1, GL_FALSE, inverseRotation);
+    glUniform1i(hasDisplayLocation_, displayTexture_ != 0);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, backgroundTexture_);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, displayTexture_);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <GLFW/glfw3.h>
+#include <cstddef>
+#include <cstdint>
+
+// OpenGL 3.3 core profile renderer for the emulator window. The UI background
+// and the rotated, scaled display are composited by one shader in a single
+// draw call. Display frames are streamed through pixel buffer objects so
+// that glTexSubImage2D returns without waiting for the copy: persistently
+// mapped and fenced when ARB_buffer_storage is available, orphaned with
+// glBufferData otherwise. Needs the GL context current on every call.
+class GLRenderer {
+public:
+    GLRenderer() = default;
+    ~GLRenderer();
+    GLRenderer(const GLRenderer&) = delete;
+    GLRenderer& operator=(const GLRenderer&) = delete;
+
+    bool Initialize();
+    void SetBackground(const uint8_t* rgba, int width, int height);
+    // Uploads rows top..bottom (inclusive) of an RGB565 frame whose rows are
+    // `stride` bytes apart (0: packed). A frame of a new size recreates the
+    // texture and is uploaded whole.
+    void UploadFrame(const uint16_t* pixels, int width, int height, int top, int bottom, size_t stride = 0);
+
+    // Draws the window. The display quad is centered at (centerX, centerY)
+    // in window coordinates, `width` x `height` before being rotated by
+    // `rotation` degrees clockwise.
+    void Draw(int viewportWidth, int viewportHeight, int windowWidth, int windowHeight,
+              float centerX, float centerY, float width, float height, int rotation);
+
+private:
+    static constexpr int UPLOAD_SLOTS = 3;
+
+    void CreateDisplayTexture(int width, int height);
+    void ReleaseUploadBuffer();
+    int FreeUploadSlot();
+
+    GLuint program_ = 0;
+    GLuint vertexArray_ = 0;
+    GLuint vertexBuffer_ = 0;
+    GLuint backgroundTexture_ = 0;
+    GLuint displayTexture_ = 0;
+    int displayWidth_ = 0;
+    int displayHeight_ = 0;
+
+    GLint windowSizeLocation_ = -1;
+    GLint displayCenterLocation_ = -1;
+    GLint displaySizeLocation_ = -1;
+    GLint displayRotationLocation_ = -1;
+    GLint hasDisplayLocation_ = -1;
+
+    // Upload ring: UPLOAD_SLOTS frame-sized slots in one buffer, each
+    // guarded by a fence until the GPU has consumed it
+    bool persistentUpload_ = false;
+    GLuint uploadBuffer_ = 0;
+    uint8_t* uploadMapping_ = nullptr;
+    size_t slotBytes_ = 0;
+    int slot_ = 0;
+    GLsync fences_[UPLOAD_SLOTS] = {};
+};
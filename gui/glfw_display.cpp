@@ -1,5 +1,6 @@
 #include "glfw_display.h"
-#include <GL/gl.h>
+#include "utils/hash.h"
+#include <algorithm>
 #include <cstring>
 #include <stdexcept>
 #include <fstream>
@@ -14,6 +15,10 @@ GLFWDisplay::GLFWDisplay() {
     }
     LoadUIConfig("gui/ui.json");
 
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GLFW_TRUE);
     window_ = glfwCreateWindow(640, 480, "OP1 Emulator", nullptr, nullptr);
     if (!window_) {
         throw std::runtime_error("Failed to create GLFW window");
@@ -21,33 +26,52 @@ GLFWDisplay::GLFWDisplay() {
 
     glfwMakeContextCurrent(window_);
     glfwSwapInterval(1);
+    renderer_ = std::make_unique<GLRenderer>();
+    if (!renderer_->Initialize()) {
+        throw std::runtime_error("Failed to initialize OpenGL renderer");
+    }
 
     // Set up mouse button callback
     glfwSetWindowUserPointer(window_, this);
     glfwSetMouseButtonCallback(window_, MouseButtonCallback);
     glfwSetKeyCallback(window_, KeyCallback);
+    glfwSetWindowRefreshCallback(window_, WindowRefreshCallback);
 
-    backgroundTexture_ = LoadBackgroundTexture(uiConfig_.background, windowWidth_, windowHeight_);
+    LoadBackground(uiConfig_.background, windowWidth_, windowHeight_);
     windowWidth_ = static_cast<int>(windowWidth_ * uiConfig_.scale);
     windowHeight_ = static_cast<int>(windowHeight_ * uiConfig_.scale);
     glfwSetWindowSize(window_, windowWidth_, windowHeight_);
 }
 
 GLFWDisplay::~GLFWDisplay() {
-    if (texture_) {
-        glDeleteTextures(1, &texture_);
-    }
     if (window_) {
+        glfwMakeContextCurrent(window_);
+        renderer_.reset();
         glfwDestroyWindow(window_);
     }
     glfwTerminate();
 }
 
 void GLFWDisplay::Initialize(int rows, int lines) {
+    // The PPI reinitializes on every control register write while enabled
+    if (rows == width_ && lines == height_) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(framebufferMutex_);
     width_ = rows;
     height_ = lines;
-
-    framebuffer_.resize(width_ * height_, 0);
+    for (auto& frame : frames_) {
+        frame.pixels.assign(width_ * height_, 0);
+        frame.scanout = nullptr;
+        frame.dirtyTop = 0;
+        frame.dirtyBottom = -1;
+    }
+    // Hand the GUI a blank frame at the new size
+    writeIndex_ = 0;
+    publishedIndex_ = 1;
+    readIndex_ = 2;
+    frames_[publishedIndex_].sequence = ++sequence_;
+    latest_.store(publishedIndex_ | FRAME_FRESH, std::memory_order_release);
 }
 
 void GLFWDisplay::LoadUIConfig(const std::string& path) {
@@ -136,35 +160,15 @@ void GLFWDisplay::LoadUIConfig(const std::string& path) {
     }
 }
 
-GLuint GLFWDisplay::LoadBackgroundTexture(const std::string& path, int& width, int& height) {
+void GLFWDisplay::LoadBackground(const std::string& path, int& width, int& height) {
     int channels;
     std::string fullPath = "gui/" + path;
     unsigned char* data = stbi_load(fullPath.c_str(), &width, &height, &channels, 4);
     if (!data) {
         throw std::runtime_error("Failed to load background image: " + fullPath);
     }
-
-    GLuint texture;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-
+    renderer_->SetBackground(data, width, height);
     stbi_image_free(data);
-    return texture;
-}
-
-void GLFWDisplay::CreateTexture() {
-    glGenTextures(1, &texture_);
-    glBindTexture(GL_TEXTURE_2D, texture_);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
-
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width_, height_, 0,
-                 GL_RGB, GL_UNSIGNED_SHORT_5_6_5, framebuffer_.data());
 }
 
 void GLFWDisplay::UpdateRowBuffer(int x, int y, const void* data, int length) {
@@ -176,93 +180,127 @@ void GLFWDisplay::UpdateRowBuffer(int x, int y, const void* data, int length) {
     }
 
     if (pixelsToCopy > 0) {
-        std::lock_guard<std::mutex> lock(framebufferMutex_);
-        std::memcpy(&framebuffer_[y * width_ + x], data, pixelsToCopy * sizeof(uint16_t));
-        dirty_ = true;
+        // The guest rewrites every row each frame; only rows that differ
+        // from the previous frame are uploaded
+        Frame& frame = frames_[writeIndex_];
+        size_t offset = y * width_ + x;
+        size_t bytes = pixelsToCopy * sizeof(uint16_t);
+        std::memcpy(&frame.pixels[offset], data, bytes);
+        const Frame& previous = frames_[publishedIndex_];
+        if (!previous.scanout && std::memcmp(&frame.pixels[offset], &previous.pixels[offset], bytes) == 0) {
+            return;
+        }
+        if (frame.dirtyBottom < frame.dirtyTop) {
+            frame.dirtyTop = frame.dirtyBottom = y;
+        } else {
+            frame.dirtyTop = std::min(frame.dirtyTop, y);
+            frame.dirtyBottom = std::max(frame.dirtyBottom, y);
+        }
     }
 }
 
-void GLFWDisplay::DrawTexturedQuad(GLuint texture, float x, float y, float w, float h, float texW, float texH) {
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glBegin(GL_QUADS);
-    glTexCoord2f(0, 0);    glVertex2f(x, y);
-    glTexCoord2f(texW, 0); glVertex2f(x + w, y);
-    glTexCoord2f(texW, texH); glVertex2f(x + w, y + h);
-    glTexCoord2f(0, texH); glVertex2f(x, y + h);
-    glEnd();
+void GLFWDisplay::FrameComplete() {
+    Frame& frame = frames_[writeIndex_];
+    if (frame.dirtyBottom < frame.dirtyTop) {
+        return; // same as the previous frame, keep filling this buffer
+    }
+    PublishFrame();
 }
 
-void GLFWDisplay::RenderFramebuffer() {
-    if (!window_) return;
+bool GLFWDisplay::ScanoutFrame(const void* pixels, int stride) {
+    if (!zeroCopyScanout_) {
+        return false;
+    }
+    Frame& frame = frames_[writeIndex_];
+    frame.scanout = static_cast<const uint8_t*>(pixels);
+    frame.stride = stride;
+    PublishFrame();
+    return true;
+}
 
-    glfwMakeContextCurrent(window_);
+void GLFWDisplay::PublishFrame() {
+    frames_[writeIndex_].sequence = ++sequence_;
+    publishedIndex_ = writeIndex_;
+    writeIndex_ = latest_.exchange(writeIndex_ | FRAME_FRESH, std::memory_order_acq_rel) & FRAME_INDEX_MASK;
+    Frame& next = frames_[writeIndex_];
+    next.scanout = nullptr;
+    next.dirtyTop = 0;
+    next.dirtyBottom = -1;
+    glfwPostEmptyEvent(); // wake the GUI thread out of WaitEvents()
+}
 
-    if (dirty_) {
-        std::lock_guard<std::mutex> lock(framebufferMutex_);
-        if (texture_ == 0) {
-            CreateTexture();
-        }
-        glBindTexture(GL_TEXTURE_2D, texture_);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width_, height_,
-                        GL_RGB, GL_UNSIGNED_SHORT_5_6_5, framebuffer_.data());
-        dirty_ = false;
-    }
+void GLFWDisplay::RenderFramebuffer() {
+    if (!window_) return;
 
     int fbWidth, fbHeight;
     glfwGetFramebufferSize(window_, &fbWidth, &fbHeight);
-    glViewport(0, 0, fbWidth, fbHeight);
-
-    glClear(GL_COLOR_BUFFER_BIT);
-
-    // Set up orthographic projection for pixel-perfect rendering
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    glOrtho(0, windowWidth_, windowHeight_, 0, -1, 1);
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-
-    glEnable(GL_TEXTURE_2D);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-    // Draw background
-    if (backgroundTexture_) {
-        DrawTexturedQuad(backgroundTexture_, 0, 0, windowWidth_, windowHeight_);
+    if (fbWidth != viewportWidth_ || fbHeight != viewportHeight_) {
+        viewportWidth_ = fbWidth;
+        viewportHeight_ = fbHeight;
+        redraw_ = true;
     }
 
-    // Draw display framebuffer in the designated area with rotation
-    if (texture_) {
-        glPushMatrix();
-
-        // Calculate center of display area
-        float centerX = uiConfig_.display.left + uiConfig_.display.width / 2.0f;
-        float centerY = uiConfig_.display.top + uiConfig_.display.height / 2.0f;
-
-        // Translate to center, rotate, translate back
-        glTranslatef(centerX, centerY, 0);
-        glRotatef(rotation_, 0, 0, 1);
+    glfwMakeContextCurrent(window_);
 
-        // Swap width and height for 90° and 270° rotations
-        float drawWidth = uiConfig_.display.width;
-        float drawHeight = uiConfig_.display.height;
-        if (rotation_ == 90 || rotation_ == 270) {
-            std::swap(drawWidth, drawHeight);
+    if (latest_.load(std::memory_order_acquire) & FRAME_FRESH) {
+        std::lock_guard<std::mutex> lock(framebufferMutex_);
+        readIndex_ = latest_.exchange(readIndex_, std::memory_order_acq_rel) & FRAME_INDEX_MASK;
+        const Frame& frame = frames_[readIndex_];
+        if (frame.scanout) {
+            // Read from guest RAM now, racing the guest like a real scanout
+            // would; frames that hash the same as the last one are skipped
+            size_t rowBytes = width_ * sizeof(uint16_t);
+            uint64_t hash = 0;
+            for (int y = 0; y < height_; y++) {
+                hash = Hash64(frame.scanout + y * frame.stride, rowBytes, hash);
+            }
+            if (!uploadedScanout_ || hash != uploadedHash_) {
+                renderer_->UploadFrame(reinterpret_cast<const uint16_t*>(frame.scanout), width_, height_,
+                                       0, height_ - 1, frame.stride);
+                uploadedHash_ = hash;
+                redraw_ = true;
+            }
+            uploadedScanout_ = true;
+        } else {
+            // The dirty band is relative to the previous frame, so after
+            // skipped frames the whole texture is refreshed
+            bool consecutive = frame.sequence == uploadedSequence_ + 1;
+            int top = consecutive ? frame.dirtyTop : 0;
+            int bottom = consecutive ? frame.dirtyBottom : height_ - 1;
+            renderer_->UploadFrame(frame.pixels.data(), width_, height_, top, bottom);
+            uploadedScanout_ = false;
+            redraw_ = true;
         }
-
-        glTranslatef(-drawWidth / 2.0f, -drawHeight / 2.0f, 0);
-        DrawTexturedQuad(texture_, 0, 0, drawWidth, drawHeight);
-        glPopMatrix();
+        uploadedSequence_ = frame.sequence;
     }
 
-    glDisable(GL_BLEND);
-    glDisable(GL_TEXTURE_2D);
+    // Nothing changed: keep the previous frame on screen
+    if (!redraw_) return;
+    redraw_ = false;
+
+    // Swap width and height for 90° and 270° rotations
+    float drawWidth = uiConfig_.display.width;
+    float drawHeight = uiConfig_.display.height;
+    if (rotation_ == 90 || rotation_ == 270) {
+        std::swap(drawWidth, drawHeight);
+    }
+    float centerX = uiConfig_.display.left + uiConfig_.display.width / 2.0f;
+    float centerY = uiConfig_.display.top + uiConfig_.display.height / 2.0f;
+    renderer_->Draw(fbWidth, fbHeight, windowWidth_, windowHeight_, centerX, centerY, drawWidth, drawHeight, rotation_);
 
     glfwSwapBuffers(window_);
 }
 
-void GLFWDisplay::PollEvents() {
-    glfwPollEvents();
+void GLFWDisplay::WaitEvents(std::chrono::nanoseconds timeout) {
+    if (timeout.count() > 0) {
+        glfwWaitEventsTimeout(std::chrono::duration<double>(timeout).count());
+    } else {
+        glfwPollEvents();
+    }
     RenderFramebuffer();
+}
+
+void GLFWDisplay::StartFrame() {
     if (onFrameStartCallback_) {
         onFrameStartCallback_(*this);
     }
@@ -281,6 +319,14 @@ void GLFWDisplay::SwapBuffers() {
 void GLFWDisplay::SetDisplayRotation(int degrees) {
     rotation_ = degrees % 360;
     if (rotation_ < 0) rotation_ += 360;
+    redraw_ = true;
+}
+
+void GLFWDisplay::WindowRefreshCallback(GLFWwindow* window) {
+    auto* display = static_cast<GLFWDisplay*>(glfwGetWindowUserPointer(window));
+    if (display) {
+        display->redraw_ = true;
+    }
 }
 
 void GLFWDisplay::MouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
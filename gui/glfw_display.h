@@ -2,12 +2,16 @@
 
 #include "peripheral/display.h"
 #include "peripheral/keyboard.h"
+#include "gl_renderer.h"
 #include <GLFW/glfw3.h>
 #include <vector>
 #include <tuple>
 #include <cstdint>
 #include <string>
 #include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
 
 struct DisplayRect {
     int left;
@@ -62,37 +66,79 @@ public:
     // Display interface
     void Initialize(int rows, int lines) override;
     void UpdateRowBuffer(int x, int y, const void* data, int length) override;
+    void FrameComplete() override;
+    bool ScanoutFrame(const void* pixels, int stride) override;
     void SetOnFrameStartCallback(const std::function<void(Display&)>& callback) override {
         onFrameStartCallback_ = callback;
     }
+    // Present frames straight from guest RAM instead of copying each row
+    // (on by default). Call before the emulator starts.
+    void SetZeroCopyScanout(bool enabled) { zeroCopyScanout_ = enabled; }
     void RenderFramebuffer();
-    void PollEvents();
+    // Blocks until an input event, a newly published frame or `timeout`,
+    // then handles input and presents the latest frame
+    void WaitEvents(std::chrono::nanoseconds timeout);
+    // Raises the frame start signal towards the guest
+    void StartFrame();
     bool ShouldClose() const;
     void SwapBuffers();
     void SetDisplayRotation(int degrees);
     uint8_t GetVolumeValue() const { return volumeValue_; }
 
 private:
-    void CreateTexture();
+    void PublishFrame();
     void LoadUIConfig(const std::string& path);
-    GLuint LoadBackgroundTexture(const std::string& path, int& width, int& height);
-    void DrawTexturedQuad(GLuint texture, float x, float y, float w, float h, float texW = 1.0f, float texH = 1.0f);
+    void LoadBackground(const std::string& path, int& width, int& height);
     static void MouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
     static void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
+    static void WindowRefreshCallback(GLFWwindow* window);
     void HandleMouseButton(int button, int action, double x, double y);
     void HandleKeyboard(int key, int action);
     int MapKeyNameToGLFW(const std::string& keyName);
 
     GLFWwindow* window_ = nullptr;
-    GLuint texture_ = 0;
-    GLuint backgroundTexture_ = 0;
-    std::vector<uint16_t> framebuffer_;
+    std::unique_ptr<GLRenderer> renderer_;
+
+    // Triple-buffered frames. The CPU thread fills frames_[writeIndex_] and
+    // on FrameComplete() swaps it into latest_; the GUI thread swaps its
+    // frames_[readIndex_] for latest_ whenever that holds a newer frame.
+    // Neither side waits for the other. A PPI frame rewrites every row, so
+    // the stale contents of a recycled back buffer are never shown.
+    // Scanout frames carry a pointer into guest RAM instead of pixels.
+    struct Frame {
+        std::vector<uint16_t> pixels;
+        const uint8_t* scanout = nullptr;
+        int stride = 0;
+        uint64_t sequence = 0;
+        // Rows that differ from the previous frame, inclusive; empty while
+        // dirtyBottom < dirtyTop
+        int dirtyTop = 0;
+        int dirtyBottom = -1;
+    };
+    static constexpr int FRAME_FRESH = 4; // latest_ holds a frame the GUI has not taken
+    static constexpr int FRAME_INDEX_MASK = 3;
+    Frame frames_[3];
+    std::atomic<int> latest_{1};
+    int writeIndex_ = 0;     // CPU thread
+    int publishedIndex_ = 1; // CPU thread, last frame handed over
+    int readIndex_ = 2;      // GUI thread
+    uint64_t sequence_ = 0;  // CPU thread
+    uint64_t uploadedSequence_ = 0;
+    bool zeroCopyScanout_ = true;
+    // Hash of the last scanout frame uploaded, to skip unchanged ones
+    bool uploadedScanout_ = false;
+    uint64_t uploadedHash_ = 0;
+    // Taken only by Initialize() and by the GUI thread while it reads a
+    // frame, so that the buffers can be resized
+    std::mutex framebufferMutex_;
     int width_ = 0;
     int height_ = 0;
     int scale_ = 2;  // Scale factor for display
     int rotation_ = 90;  // Rotation in degrees
-    bool dirty_ = false;
-    std::mutex framebufferMutex_;  // Protect framebuffer access
+    // The window contents are stale (first frame, resize, expose, rotation)
+    bool redraw_ = true;
+    int viewportWidth_ = 0;
+    int viewportHeight_ = 0;
     std::function<void(Display&)> onFrameStartCallback_;
 
     UIConfig uiConfig_;
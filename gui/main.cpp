@@ -5,6 +5,10 @@
 #include "utils/log.h"
 #include "glfw_display.h"
 #include "audio_output_miniaudio.h"
+#include "audio_input_miniaudio.h"
+#include "peripheral/wav_audio_input.h"
+#include "peripheral/file_audio_output.h"
+#include "peripheral/headless_display.h"
 #include "usbipd.h"
 #include <vector>
 #include <iostream>
@@ -13,8 +17,17 @@
 #include <atomic>
 #include <chrono>
 #include <cstdlib>
+#include <cstring>
+#include <csignal>
 
 std::atomic<bool> cpuShouldStop(false);
+std::atomic<bool> dmaStatsRequested(false);
+std::atomic<bool> stopRequested(false);
+
+// Rate of the frame start (TE) signal the guest renders on
+static constexpr auto FRAME_INTERVAL = std::chrono::nanoseconds(1'000'000'000 / 60);
+// The accelerometer is fed placeholder noise at this rate
+static constexpr auto ACCELERATION_INTERVAL = std::chrono::milliseconds(100);
 
 void LdrExecutionThread(BlackFinCpu& cpu, const LDRParser& parser) {
     const auto& dxes = parser.getDXEs();
@@ -70,17 +83,96 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    // Create GLFW Display
-    auto display = std::make_shared<GLFWDisplay>();
+    // OP1EMU_HEADLESS=<frames>: run without a window, stopping after that
+    // many display frames (0 or SIGINT to run until interrupted).
+    // OP1EMU_FRAME_DUMP=<file.y4m>|<file.raw>|<prefix>: also write every frame
+    // to a Y4M or raw RGB565 stream, or to <prefix>NNNNNN.png files
+    const char* headless = std::getenv("OP1EMU_HEADLESS");
+    uint64_t headlessFrames = headless ? std::strtoull(headless, nullptr, 10) : 0;
+    std::shared_ptr<GLFWDisplay> display;
+    std::shared_ptr<HeadlessDisplay> headlessDisplay;
 
     // Create BlackFin CPU
     BlackFinCpu cpu;
-    cpu.AttachDisplay(display);
-    cpu.AttachKeyboard(display);
-    auto audioOutput = std::make_shared<MiniaudioOutput>();
+    if (headless) {
+        headlessDisplay = std::make_shared<HeadlessDisplay>();
+        cpu.AttachDisplay(headlessDisplay);
+        if (const char* dumpPath = std::getenv("OP1EMU_FRAME_DUMP")) {
+            std::string path = dumpPath;
+            auto endsWith = [&path](const char* suffix) {
+                size_t n = strlen(suffix);
+                return path.size() >= n && path.compare(path.size() - n, n, suffix) == 0;
+            };
+            headlessDisplay->StartDump(path, endsWith(".y4m") ? HeadlessDisplay::DumpFormat::Y4m
+                                           : endsWith(".raw") ? HeadlessDisplay::DumpFormat::Raw
+                                           : HeadlessDisplay::DumpFormat::Png);
+        }
+        std::signal(SIGINT, [](int) { stopRequested.store(true); });
+        std::signal(SIGTERM, [](int) { stopRequested.store(true); });
+    } else {
+        display = std::make_shared<GLFWDisplay>();
+        // OP1EMU_SCANOUT=copy: copy PPI rows instead of presenting frames
+        // straight from guest RAM
+        const char* scanout = std::getenv("OP1EMU_SCANOUT");
+        display->SetZeroCopyScanout(!scanout || std::string(scanout) != "copy");
+        cpu.AttachDisplay(display);
+        cpu.AttachKeyboard(display);
+    }
+    // OP1EMU_AUDIO_OUTPUT=null|<file.wav>|<file.raw>: write audio without a
+    // sound device instead of playing it
+    std::shared_ptr<AudioOutput> audioOutput;
+    if (const char* audioPath = std::getenv("OP1EMU_AUDIO_OUTPUT")) {
+        std::string path = audioPath;
+        if (path == "null") {
+            audioOutput = std::make_shared<NullAudioOutput>();
+        } else {
+            bool raw = path.size() >= 4 && path.compare(path.size() - 4, 4, ".raw") == 0;
+            audioOutput = std::make_shared<FileAudioOutput>(path, raw ? FileAudioOutput::Format::Raw : FileAudioOutput::Format::Wav);
+        }
+    } else {
+        audioOutput = std::make_shared<MiniaudioOutput>();
+    }
     cpu.AttachAudioOutput(audioOutput);
+    // OP1EMU_AUDIO_INPUT=capture|<file.wav>: feed the SPORT receive path from
+    // the default capture device or a looped WAV file
+    if (const char* audioInput = std::getenv("OP1EMU_AUDIO_INPUT")) {
+        if (std::string(audioInput) == "capture") {
+            auto capture = std::make_shared<MiniaudioInput>();
+            if (capture->IsActive()) {
+                cpu.AttachAudioInput(capture);
+            }
+        } else {
+            auto wav = std::make_shared<WavAudioInput>(audioInput, true);
+            if (wav->IsLoaded()) {
+                cpu.AttachAudioInput(wav);
+            }
+        }
+    }
     cpu.SetBootMode(0x0D); // Set BMODE to 0b1101, boot from NAND flash with port H
 
+    // OP1EMU_PACING=audio|realtime|free: what guest time follows, audio by default
+    const char* pacing = std::getenv("OP1EMU_PACING");
+    if (pacing && std::string(pacing) == "free") {
+        cpu.SetPacingMode(PacingMode::FreeRun);
+    } else if (pacing && std::string(pacing) == "realtime") {
+        cpu.SetPacingMode(PacingMode::RealTime);
+    } else {
+        cpu.SetPacingMode(PacingMode::Audio);
+    }
+
+    // OP1EMU_AUDIO_STATS=<seconds>: log audio underruns, drops and latency
+    if (const char* audioStats = std::getenv("OP1EMU_AUDIO_STATS")) {
+        int seconds = std::atoi(audioStats);
+        cpu.SetAudioStatsInterval(std::chrono::seconds(seconds > 0 ? seconds : 10));
+    }
+
+    // OP1EMU_DMA_STATS=<file>: record a DMA timeline, dump it on SIGUSR1 and at exit
+    const char* dmaStatsPath = std::getenv("OP1EMU_DMA_STATS");
+    if (dmaStatsPath) {
+        cpu.EnableDMATimeline(65536);
+        std::signal(SIGUSR1, [](int) { dmaStatsRequested.store(true); });
+    }
+
     auto loop = uvw::loop::get_default();
     std::thread uvloop([loop]() {
         while (true) {
@@ -98,7 +190,22 @@ int main(int argc, char* argv[]) {
     }
 
     // Load NAND Flash underlying storage
-    auto nandFlash = std::make_shared<MT29F4G08>(cpu, argv[1]);
+    // OP1EMU_NAND_BASE=<image>: share a read-only NAND image between instances,
+    // argv[1] is then this instance's delta file (see tools/nanddelta.cpp)
+    const char* nandBase = std::getenv("OP1EMU_NAND_BASE");
+    auto nandFlash = std::make_shared<MT29F4G08>(cpu, argv[1], nandBase ? nandBase : "");
+    // OP1EMU_NAND_SYNC=sync|idle|<ms>: write NAND changes back before each
+    // program/erase completes, once writes pause, or every <ms> (default 1000)
+    if (const char* nandSync = std::getenv("OP1EMU_NAND_SYNC")) {
+        std::string policy = nandSync;
+        if (policy == "sync") {
+            nandFlash->SetDurability(NandDurability::Synchronous);
+        } else if (policy == "idle") {
+            nandFlash->SetDurability(NandDurability::Idle);
+        } else if (int ms = std::atoi(nandSync); ms > 0) {
+            nandFlash->SetDurability(NandDurability::Periodic, std::chrono::milliseconds(ms));
+        }
+    }
     cpu.AttachNandFlash(nandFlash);
 
     // Start CPU execution thread
@@ -110,23 +217,66 @@ int main(int argc, char* argv[]) {
         cpuThread = std::thread(BootExcutionThread, std::ref(cpu));
     }
 
-    // Main thread handles GLFW display
-    while (!display->ShouldClose()) {
-        display->PollEvents();
-        int16_t ax = static_cast<int16_t>((std::rand() % (540 - 50 + 1)) + 50); // ax in [50, 540]
-        int16_t ay = static_cast<int16_t>((std::rand() % (-50 - (-540) + 1)) + (-540)); // ay in [-540, -50]
-        int16_t az = static_cast<int16_t>((std::rand() % (874 - 75 + 1)) + 75); // az in [75, 874]
-        cpu.SetAcceleration(ax, ay, az); // Placeholder for random accelerometer data
-        cpu.SetPotentiometerValue(0xFF - display->GetVolumeValue()); // Update potentiometer (volume) value
-
-        // Small sleep to prevent busy-waiting
-        std::this_thread::sleep_for(std::chrono::milliseconds(16)); // ~60 FPS
+    // Main thread drives the display
+    auto shouldStop = [&]() {
+        if (headlessDisplay) {
+            return stopRequested.load() || (headlessFrames && headlessDisplay->FrameCount() >= headlessFrames);
+        }
+        return display->ShouldClose();
+    };
+    auto nextFrame = std::chrono::steady_clock::now();
+    auto nextAcceleration = nextFrame;
+    int volume = -1;
+    while (!shouldStop()) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= nextFrame) {
+            if (display) {
+                display->StartFrame();
+            } else {
+                headlessDisplay->StartFrame();
+            }
+            nextFrame += FRAME_INTERVAL;
+            if (nextFrame < now) {
+                nextFrame = now + FRAME_INTERVAL; // fell behind, don't burst
+            }
+        }
+        if (now >= nextAcceleration) {
+            int16_t ax = static_cast<int16_t>((std::rand() % (540 - 50 + 1)) + 50); // ax in [50, 540]
+            int16_t ay = static_cast<int16_t>((std::rand() % (-50 - (-540) + 1)) + (-540)); // ay in [-540, -50]
+            int16_t az = static_cast<int16_t>((std::rand() % (874 - 75 + 1)) + 75); // az in [75, 874]
+            cpu.SetAcceleration(ax, ay, az); // Placeholder for random accelerometer data
+            nextAcceleration = now + ACCELERATION_INTERVAL;
+        }
+        if (display && display->GetVolumeValue() != volume) {
+            volume = display->GetVolumeValue();
+            cpu.SetPotentiometerValue(0xFF - volume); // Update potentiometer (volume) value
+        }
+        if (dmaStatsPath && dmaStatsRequested.exchange(false)) {
+            cpu.QueueEvent([&cpu, dmaStatsPath]() {
+                cpu.DumpDMAStatistics(dmaStatsPath);
+            });
+        }
+
+        // Sleep until the next frame start, input or a new frame to present
+        if (display) {
+            display->WaitEvents(nextFrame - std::chrono::steady_clock::now());
+        } else {
+            std::this_thread::sleep_until(nextFrame);
+        }
     }
 
     // Signal CPU thread to stop and wait for it
     LogInfo("Stopping CPU thread...");
     cpuShouldStop.store(true);
     cpuThread.join();
+    nandFlash->Flush();
+    if (dmaStatsPath) {
+        cpu.DumpDMAStatistics(dmaStatsPath);
+    }
+    if (headlessDisplay) {
+        LogInfo("Display: %llu frames, last frame hash %016llx",
+                (unsigned long long)headlessDisplay->FrameCount(), (unsigned long long)headlessDisplay->FrameHash());
+    }
 
     return 0;
 }
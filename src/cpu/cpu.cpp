@@ -23,12 +23,16 @@
 #include "peripheral/keyboard.h"
 #include "peripheral/potentiometer.h"
 #include "peripheral/audio_output.h"
+#include "peripheral/audio_input.h"
 #include "utils/log.h"
 
 #include "core.h"
 #include "cpu_state.h"
 #include "mmr.h"
 #include <cstring>
+#include <fstream>
+#include <thread>
+#include <algorithm>
 
 // bcore CEC functions (extern "C" in bcore's src/cec.h)
 extern "C" void cec_raise(CpuState* cpu, uint32_t ivg);
@@ -158,7 +162,7 @@ BlackFinCpu::BlackFinCpu() : pc(0) {
 
     ppi = std::make_shared<PPI>(0xFFC01000);
     devices.emplace_back(ppi);
-    std::shared_ptr<DMA> dma = std::make_shared<DMA>(0xFFC00C00, emulator);
+    dma = std::make_shared<DMA>(0xFFC00C00, emulator);
     devices.emplace_back(dma);
     dma->AttachDMABus(DMAPeripheralType::DMAPeripheralPPI, ppi);
     dma->AttachDMABus(DMAPeripheralType::DMAPeripheralNFC, nfc);
@@ -253,29 +257,11 @@ BlackFinCpu::BlackFinCpu() : pc(0) {
         emulator.BindDevice(device.get());
     }
 
-    std::array<GPIOPeripheral::GPIOConnection, OLED::DATA_PINS> oledDatabus{
-        std::tuple<GPIOPeripheral&, int>{*portF, 0},
-        std::tuple<GPIOPeripheral&, int>{*portF, 1},
-        std::tuple<GPIOPeripheral&, int>{*portF, 2},
-        std::tuple<GPIOPeripheral&, int>{*portF, 3},
-        std::tuple<GPIOPeripheral&, int>{*portF, 4},
-        std::tuple<GPIOPeripheral&, int>{*portF, 5},
-        std::tuple<GPIOPeripheral&, int>{*portF, 6},
-        std::tuple<GPIOPeripheral&, int>{*portF, 7},
-        std::tuple<GPIOPeripheral&, int>{*portF, 8},
-        std::tuple<GPIOPeripheral&, int>{*portF, 9},
-        std::tuple<GPIOPeripheral&, int>{*portF, 10},
-        std::tuple<GPIOPeripheral&, int>{*portF, 11},
-        std::tuple<GPIOPeripheral&, int>{*portF, 12},
-        std::tuple<GPIOPeripheral&, int>{*portF, 13},
-        std::tuple<GPIOPeripheral&, int>{*portF, 14},
-        std::tuple<GPIOPeripheral&, int>{*portF, 15},
-    };
     std::tuple<GPIOPeripheral&, int> oledWr {*portG, 11};
     std::tuple<GPIOPeripheral&, int> oledCs {*portG, 5};
     std::tuple<GPIOPeripheral&, int> oledRd {*portG, 4};
     std::tuple<GPIOPeripheral&, int> oledRs {*portG, 2};
-    oled = std::make_shared<OLED>(oledDatabus, oledCs, oledRs, oledRd, oledWr);
+    oled = std::make_shared<OLED>(*portF, oledCs, oledRs, oledRd, oledWr);
 
     // Initialize bcore after all devices are bound
     bcoreMemory_ = std::make_unique<EmulatorMemory>(emulator);
@@ -292,7 +278,7 @@ BlackFinCpu::BlackFinCpu() : pc(0) {
     cpuState_->usp = 0x7000000;
     cpuState_->syscfg = 0x30;
 
-    startTime = std::chrono::system_clock::now();
+    realTimeStart = std::chrono::steady_clock::now();
 }
 
 BlackFinCpu::~BlackFinCpu() {
@@ -314,18 +300,39 @@ void BlackFinCpu::RestoreContext() {
     // TODO
 }
 
+static constexpr u64 CCLK_HZ = 400'000'000; // assuming 400MHz CPU clock
+// Guest time charged for a basic block when the core does not count cycles
+// (CYCLES only runs with SYSCFG.CCEN set)
+static constexpr u64 CYCLES_PER_BLOCK = 8;
+// Pacing is checked once per millisecond of guest time
+static constexpr u64 PACE_INTERVAL_CYCLES = CCLK_HZ / 1000;
+// Longest time to wait for the audio output to drain before assuming the
+// device has stalled and running on
+static constexpr auto AUDIO_PACE_TIMEOUT = std::chrono::milliseconds(100);
+// Guest time further behind the host than this is given up rather than
+// caught up in a burst
+static constexpr auto REAL_TIME_MAX_LAG = std::chrono::milliseconds(100);
+// SPORT transmit may trail its clock by up to one DMA request's worth of
+// frames without the guest falling behind
+static constexpr u64 EXPECTED_SHORTFALL_FRAMES = 64;
+
 static void SetBfinCycles(CpuState& cpu_state, u64 cycles) {
     cpu_state.cycles[0] = (u32)(cycles & 0xffffffff);
     cpu_state.cycles[1] = (u32)(cycles >> 32);
     cpu_state.cycles[2] = cpu_state.cycles[1];
 }
 
+static u64 GetBfinCycles(const CpuState& cpu_state) {
+    return ((u64)cpu_state.cycles[1] << 32) | cpu_state.cycles[0];
+}
+
 HaltReason BlackFinCpu::Run() {
-    auto microSecondsElapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now() - startTime).count();
-    auto cyclesElapsed = microSecondsElapsed * 400; // assuming 400MHz CPU clock
-    // Sync cycles with system time
-    SetBfinCycles(*cpuState_, cyclesElapsed);
-    coreTimer->UpdateCycles(cyclesElapsed);
+    // Guest time follows executed code, not the host clock; Pace() ties the
+    // two together.
+    SetBfinCycles(*cpuState_, cycles);
+    coreTimer->UpdateCycles(cycles);
+    sport0->UpdateCycles(cycles);
+    sport1->UpdateCycles(cycles);
 
     // Hit entry point, invalidating core to reset cached translations
     if (cpuState_->pc == 0xFFA00000) {
@@ -336,6 +343,9 @@ HaltReason BlackFinCpu::Run() {
     core_->run(cpuState_->pc);
     cpuState_->did_jump = false; // Clear jump flag set by bcore, since we handle it in the emulator loop
     cec_check_pending(cpuState_.get());
+    u64 previousCycles = cycles;
+    u64 counted = GetBfinCycles(*cpuState_);
+    cycles += std::max(counted > cycles ? counted - cycles : 0, CYCLES_PER_BLOCK);
 
     // Get active IVG from CEC
     int ivg = cec_current_ivg();
@@ -343,16 +353,51 @@ HaltReason BlackFinCpu::Run() {
         device->ProcessWithInterrupt(ivg);
     }
     // FIXME: use correct clock
-    if (cyclesElapsed % 10000 == 0) {
+    if (cycles / 10000 != previousCycles / 10000) {
         gptimer->Tick(GPTimerClockTypeSCLK);
         gptimer->Tick(GPTimerClockTypeTACLK);
         gptimer->Tick(GPTimerClockTypeTMRCLK);
     }
 
     ProcessEvents();
+    if (cycles >= nextPaceCycles) {
+        nextPaceCycles = cycles + PACE_INTERVAL_CYCLES;
+        Pace();
+        if (audioStatsInterval && cycles >= nextAudioStatsCycles) {
+            nextAudioStatsCycles = cycles + audioStatsInterval;
+            LogAudioStats();
+        }
+    }
     return HaltReason::Break;
 }
 
+// Sleeps the CPU thread while guest time is ahead of its master clock.
+void BlackFinCpu::Pace() {
+    if (pacing == PacingMode::FreeRun) {
+        return;
+    }
+    auto guestTime = std::chrono::nanoseconds(cycles * 1000 / (CCLK_HZ / 1'000'000));
+    auto now = std::chrono::steady_clock::now();
+
+    if (pacing == PacingMode::Audio && audioOutput && audioOutput->QueuedFrames() > 0) {
+        // The device callback drains the output at the host's audio rate, so
+        // the guest may only run once the queue drops below its target. The
+        // output leaves the fill to this loop (see SetPacingMode).
+        audioOutput->WaitQueuedBelow(audioOutput->TargetQueuedFrames(), now + AUDIO_PACE_TIMEOUT);
+        now = std::chrono::steady_clock::now();
+        // Keep the real-time reference aligned for when the audio stops
+        realTimeStart = now - std::chrono::duration_cast<std::chrono::steady_clock::duration>(guestTime);
+        return;
+    }
+
+    auto hostTime = now - realTimeStart;
+    if (guestTime > hostTime) {
+        std::this_thread::sleep_for(guestTime - hostTime);
+    } else if (hostTime - guestTime > REAL_TIME_MAX_LAG) {
+        realTimeStart = now - std::chrono::duration_cast<std::chrono::steady_clock::duration>(guestTime);
+    }
+}
+
 void BlackFinCpu::SetRegister(int index, u32 value) {
     switch (index)
     {
@@ -454,14 +499,31 @@ void BlackFinCpu::AttachKeyboard(const std::shared_ptr<Keyboard>& keyboard) {
     });
 }
 
+void BlackFinCpu::SetPacingMode(PacingMode mode) {
+    pacing = mode;
+    if (audioOutput) {
+        audioOutput->SetQueuePaced(mode == PacingMode::Audio);
+    }
+}
+
 void BlackFinCpu::AttachAudioOutput(const std::shared_ptr<AudioOutput>& audioOutput) {
-    auto cb = [audioOutput](const void* data, size_t samples, int channels, int bitsPerSample) {
-        audioOutput->WriteSamples(data, samples, channels, bitsPerSample);
+    this->audioOutput = audioOutput;
+    audioOutput->SetQueuePaced(pacing == PacingMode::Audio);
+    auto cb = [audioOutput](const void* data, size_t samples, int channels, int bitsPerSample, u32 sampleRate) {
+        audioOutput->WriteSamples(data, samples, channels, bitsPerSample, sampleRate);
     };
     sport0->SetAudioOutputCallback(cb);
     sport1->SetAudioOutputCallback(cb);
 }
 
+void BlackFinCpu::AttachAudioInput(const std::shared_ptr<AudioInput>& audioInput) {
+    auto cb = [audioInput](void* data, size_t samples, int channels, int bitsPerSample, u32 sampleRate) {
+        return audioInput->ReadSamples(data, samples, channels, bitsPerSample, sampleRate);
+    };
+    sport0->SetAudioInputCallback(cb);
+    sport1->SetAudioInputCallback(cb);
+}
+
 void BlackFinCpu::SetAcceleration(int16_t x, int16_t y, int16_t z) {
     QueueEvent([this, x, y, z]() {
         this->adxl345->SetAcceleration(x, y, z);
@@ -474,6 +536,68 @@ void BlackFinCpu::SetPotentiometerValue(u8 value) {
     });
 }
 
+void BlackFinCpu::EnableDMATimeline(size_t capacity) {
+    dma->EnableTimeline(capacity);
+}
+
+void BlackFinCpu::DumpDMAStatistics(const std::string& path) {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        LogError("Failed to open DMA statistics file: %s", path.c_str());
+        return;
+    }
+    dma->WriteStatistics(file);
+    LogInfo("DMA statistics written to %s", path.c_str());
+}
+
+AudioStats BlackFinCpu::GetAudioStats() const {
+    AudioStats stats;
+    for (const auto& sport : {sport0, sport1}) {
+        SPORT::FrameCounts transmit = sport->TransmitFrameCounts();
+        SPORT::FrameCounts receive = sport->ReceiveFrameCounts();
+        stats.transmitDelivered += transmit.delivered;
+        stats.transmitExpected += transmit.expected;
+        stats.receiveDelivered += receive.delivered;
+        stats.receiveExpected += receive.expected;
+    }
+    if (audioOutput) {
+        stats.output = audioOutput->Telemetry();
+    }
+    return stats;
+}
+
+void BlackFinCpu::SetAudioStatsInterval(std::chrono::milliseconds interval) {
+    audioStatsInterval = interval.count() * (CCLK_HZ / 1000);
+    nextAudioStatsCycles = cycles + audioStatsInterval;
+    lastAudioStats = GetAudioStats();
+}
+
+// Logs the audio counters that changed since the previous call, in a fixed
+// key=value form so the log can be grepped or alerted on.
+void BlackFinCpu::LogAudioStats() {
+    AudioStats stats = GetAudioStats();
+    const AudioStats& last = lastAudioStats;
+    auto shortfall = [](u64 delivered, u64 expected) {
+        return expected > delivered ? expected - delivered : 0;
+    };
+    u64 transmitShort = shortfall(stats.transmitDelivered, stats.transmitExpected);
+    u64 lastTransmitShort = shortfall(last.transmitDelivered, last.transmitExpected);
+    u64 underrun = stats.output.underrunFrames - last.output.underrunFrames;
+    u64 dropped = stats.output.framesDropped - last.output.framesDropped;
+
+    bool lost = underrun > 0 || dropped > 0 || transmitShort > lastTransmitShort + EXPECTED_SHORTFALL_FRAMES;
+    (lost ? LogWarn : LogInfo)(
+        "Audio: tx=%llu/%llu rx=%llu/%llu queued=%llu underrun=%llu dropped=%llu jitter=%lluus max=%lluus",
+        (unsigned long long)(stats.transmitDelivered - last.transmitDelivered),
+        (unsigned long long)(stats.transmitExpected - last.transmitExpected),
+        (unsigned long long)(stats.receiveDelivered - last.receiveDelivered),
+        (unsigned long long)(stats.receiveExpected - last.receiveExpected),
+        (unsigned long long)stats.output.queuedFrames, (unsigned long long)underrun, (unsigned long long)dropped,
+        (unsigned long long)stats.output.callbackJitterMicros,
+        (unsigned long long)stats.output.maxCallbackJitterMicros);
+    lastAudioStats = stats;
+}
+
 void BlackFinCpu::SetBootMode(int mode) {
     sic->SetBootMode(mode);
 }
\ No newline at end of file
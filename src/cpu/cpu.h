@@ -1,6 +1,7 @@
 #pragma once
 
 #include "emu.h"
+#include "peripheral/audio_output.h"
 #include <memory>
 #include <vector>
 #include <chrono>
@@ -37,6 +38,26 @@ class Potentiometer;
 class GPIOPeripheral;
 class SPORT;
 class AudioOutput;
+class AudioInput;
+class DMA;
+
+// How BlackFinCpu::Run keeps guest time in step with the host.
+enum class PacingMode {
+    FreeRun,  // run as fast as the host allows
+    RealTime, // sleep while guest time is ahead of host time
+    Audio,    // sleep while the audio output holds its target fill; real time
+              // while the guest is not producing audio
+};
+
+// Audio pipeline health: SPORT transmit/receive frames moved by DMA against
+// frames their sample clocks made due, and the output's own counters.
+struct AudioStats {
+    u64 transmitDelivered = 0;
+    u64 transmitExpected = 0;
+    u64 receiveDelivered = 0;
+    u64 receiveExpected = 0;
+    AudioTelemetry output;
+};
 
 class BlackFinCpu : public CpuInterface {
 public:
@@ -58,6 +79,9 @@ public:
     USBDevice& GetUSB() { return *usb; }
 
     void SetBootMode(int mode);
+    void SetPacingMode(PacingMode mode);
+    // Emulated core clock cycles since reset
+    u64 Cycles() const { return cycles; }
 
     void QueueEvent(const std::function<void()>& event, std::chrono::nanoseconds delay = std::chrono::nanoseconds(1));
 
@@ -65,12 +89,26 @@ public:
     void AttachKeyboard(const std::shared_ptr<Keyboard>& keyboard);
     void AttachNandFlash(const std::shared_ptr<NandFlash>& nandFlash);
     void AttachAudioOutput(const std::shared_ptr<AudioOutput>& audioOutput);
+    void AttachAudioInput(const std::shared_ptr<AudioInput>& audioInput);
     void SetAcceleration(int16_t x, int16_t y, int16_t z);
     void SetPotentiometerValue(u8 value);
 
+    // DMA statistics, see DMA::WriteStatistics(). Call on the CPU thread
+    // (e.g. through QueueEvent) or while it is not running.
+    void EnableDMATimeline(size_t capacity);
+    void DumpDMAStatistics(const std::string& path);
+
+    // Audio statistics, CPU thread only. With a nonzero interval they are
+    // also logged every `interval` of guest time, as a warning when frames
+    // were lost in that interval.
+    AudioStats GetAudioStats() const;
+    void SetAudioStatsInterval(std::chrono::milliseconds interval);
+
 protected:
     void ProcessInterrupt(int pin, int level);
     void ProcessEvents();
+    void Pace();
+    void LogAudioStats();
 
     std::shared_ptr<SIC> sic;
     std::shared_ptr<CoreTimer> coreTimer;
@@ -79,6 +117,7 @@ protected:
     std::shared_ptr<OLED> oled;
     std::shared_ptr<NFC> nfc;
     std::shared_ptr<GPTimer> gptimer;
+    std::shared_ptr<DMA> dma;
     std::shared_ptr<USBDevice> usb;
     std::shared_ptr<SPORT> sport0;
     std::shared_ptr<SPORT> sport1;
@@ -90,7 +129,15 @@ protected:
     std::vector<std::tuple<std::chrono::nanoseconds, std::function<void()>>> eventQueue;
     std::recursive_mutex eventQueueMutex;
     std::chrono::nanoseconds elapsedTime{0};
-    std::chrono::system_clock::time_point startTime;
+    std::shared_ptr<AudioOutput> audioOutput;
+    PacingMode pacing = PacingMode::RealTime;
+    u64 cycles = 0;
+    u64 nextPaceCycles = 0;
+    // Host time at which guest time was zero, for real-time pacing
+    std::chrono::steady_clock::time_point realTimeStart;
+    u64 audioStatsInterval = 0; // cycles, 0 when not logging
+    u64 nextAudioStatsCycles = 0;
+    AudioStats lastAudioStats;
     Emulator emulator;
     std::unique_ptr<CpuState> cpuState_;
     std::unique_ptr<EmulatorMemory> bcoreMemory_;
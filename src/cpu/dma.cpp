@@ -1,6 +1,9 @@
 #include "dma.h"
+#include "dma_kernel.h"
 #include "utils/log.h"
 #include <stdint.h>
+#include <cstring>
+#include <deque>
 
 enum DMANextOperation {
     Stop = 0x0,
@@ -14,15 +17,43 @@ class DMAChannel : public RegisterDevice {
 public:
     DMAChannel(const std::string& name, u32 baseAddr, DMA& dma, u16 defaultPeripheralMap);
     bool IsEnabled() const { return enabled; }
-    bool IsRunning() const { return running; }
+    // Has work left. DMA_RUN reads `running`, which stays set after the
+    // last element until a delayed completion is delivered.
+    bool IsRunning() const { return running && !stopPending; }
     bool IsMDMA() const;
     bool IsMDMASource() const;
+    bool IsMemoryWrite() const { return memoryWrite; }
     DMAPeripheralType GetPeripheralType() const { return peripheralType; }
+    const DMAChannelStats& Stats() const { return stats; }
+    void CountStall() { stats.stalls++; }
+    bool IsRequested();
+    // A scanout is still in flight, see ProcessTransfer()
+    bool IsHeld() const { return dma.ServiceTick() < heldUntil; }
 
     u32 ProcessTransfer();
 
+    // Used by the MDMA fast path (DMA::ProcessMemoryTransfer)
+    int ElementBytes() const { return 1 << wordSize; }
+    bool IsContiguous() const;
+    u32 RemainingElements() const;
+    DMAWalk Walk() const;
+    u8* MapElements(u32 count);
+    void Advance(u32 count, u32 delay = 0);
+    void DeliverInterrupts(u64 tick);
+
 protected:
+    // Row/work unit completion whose status and interrupt are held back
+    // until `tick` service calls (see DMA::ProcessMemoryTransfer).
+    struct PendingCompletion {
+        u64 tick;
+        bool done;
+        bool interrupt;
+        bool stop; // the channel stops, DMA_RUN clears with DMA_DONE
+    };
+
     void ProcessDescriptor();
+    void AccessMemory(u8* buffer, u32 count, bool write);
+    void RaiseDataInterrupt();
 
     DMA& dma;
 
@@ -39,6 +70,7 @@ protected:
     bool completed = false;
     bool error = false;
     bool running = false;
+    bool stopPending = false; // finished, waiting for a delayed completion
 
     bool channelIsMemory = false; // peripheral/memory
     DMAPeripheralType peripheralType;
@@ -54,11 +86,19 @@ protected:
     u16 peripheralMap = 0;  // 0x2C
     u16 currXCount = 0;     // 0x30
     u16 currYCount = 0;     // 0x38
+
+    std::deque<PendingCompletion> pendingCompletions;
+
+    int index;
+    DMAChannelStats stats;
+    u32 workUnitBytes = 0;
+    u64 heldUntil = 0; // service tick at which a scanout has been "sent"
 };
 
 DMAChannel::DMAChannel(const std::string& name, u32 baseAddr, DMA& dma, u16 defaultPeripheralType)
     : RegisterDevice(name, baseAddr, 0x40) , dma(dma)
     , peripheralType(static_cast<DMAPeripheralType>(defaultPeripheralType))
+    , index((baseAddr - dma.BaseAddress()) / 0x40)
 {
     REG32(NEXT_DESC_PTR, 0x00);
     FIELD(NEXT_DESC_PTR, VAL, 0, 32, R(nextDescPtr), W(nextDescPtr));
@@ -79,6 +119,10 @@ DMAChannel::DMAChannel(const std::string& name, u32 baseAddr, DMA& dma, u16 defa
         next = (DMANextOperation)v;
     });
     CONFIG.writeCallback = [this](u32 value) {
+        // Completions still held back belong to the previous transfer
+        pendingCompletions.clear();
+        stopPending = false;
+        heldUntil = 0;
         running = enabled;
         if (enabled && IsMDMASource()) {
             // A new MDMA transfer starts from an empty FIFO.
@@ -160,12 +204,22 @@ void DMAChannel::ProcessDescriptor()
             dma.GetEmulator().MemoryRead(nextDescPtr, flows + offset, descriptorSize * sizeof(u16));
         }
         Write(0x00, flows, descriptorSize * sizeof(u16));
+        stats.descriptors++;
     }
 
     currDescPtr = nextDescPtr;
     currAddr = startAddr;
     currXCount = xCount ?: 0xFFFF;
     currYCount = yCount ?: 0xFFFF;
+    workUnitBytes = 0;
+    if (dma.IsTimelineEnabled()) {
+        dma.RecordEvent(index, DMAEventType::Start, startAddr, 0);
+    }
+}
+
+void DMAChannel::RaiseDataInterrupt() {
+    stats.interrupts++;
+    TriggerInterrupt(1);
 }
 
 bool DMAChannel::IsMDMA() const {
@@ -176,12 +230,150 @@ bool DMAChannel::IsMDMASource() const {
     return peripheralType == DMAPeripheralMDMASrc0 || peripheralType == DMAPeripheralMDMASrc1;
 }
 
+bool DMAChannel::IsRequested() {
+    auto bus = dma.GetDMABus(peripheralType);
+    return bus && bus->DMARequest(memoryWrite);
+}
+
+u32 DMAChannel::RemainingElements() const {
+    u32 rows = mode2D && currYCount > 1 ? currYCount - 1 : 0;
+    return currXCount + rows * xCount;
+}
+
+DMAWalk DMAChannel::Walk() const {
+    return DMAWalk{1 << wordSize, xModify, yModify, xCount, currXCount};
+}
+
+bool DMAChannel::IsContiguous() const {
+    int elementBytes = ElementBytes();
+    return xModify == elementBytes && (!mode2D || yModify == elementBytes);
+}
+
+// Host pointer of the current element if the next `count` elements all lie in
+// page-mapped RAM, nullptr otherwise.
+u8* DMAChannel::MapElements(u32 count) {
+    DMAWalk walk = Walk();
+    if (count == 0 || walk.elementBytes > 4) return nullptr;
+    u32 lo, length;
+    DMAWalkSpan(walk, currAddr, count, lo, length);
+    u8* host = dma.GetEmulator().MemoryMapRange(lo, length);
+    return host ? host + (currAddr - lo) : nullptr;
+}
+
+// Moves `count` elements between the staging buffer and guest memory,
+// starting at the current address and wrapping rows with Y_MODIFY. RAM is
+// accessed through one gather/scatter kernel on host pointers; anything not
+// page-mapped (MMRs, unmapped holes) falls back to per-element accesses.
+void DMAChannel::AccessMemory(u8* buffer, u32 count, bool write) {
+    if (count == 0) return;
+
+    auto& emu = dma.GetEmulator();
+    DMAWalk walk = Walk();
+    if (u8* first = MapElements(count)) {
+        if (write) {
+            DMAScatter(first, buffer, walk, count);
+        } else {
+            DMAGather(buffer, first, walk, count);
+        }
+        return;
+    }
+
+    u32 addr = currAddr;
+    u32 xLeft = walk.xLeft;
+    for (u32 i = 0; i < count; i++) {
+        u8* element = buffer + i * walk.elementBytes;
+        if (write) {
+            emu.MemoryWrite(addr, element, walk.elementBytes);
+        } else {
+            emu.MemoryRead(addr, element, walk.elementBytes);
+        }
+        if (--xLeft == 0) {
+            addr += yModify;
+            xLeft = xCount;
+        } else {
+            addr += xModify;
+        }
+    }
+}
+
+// Advances the channel state by `count` elements, raising row/transfer
+// interrupts and loading the next descriptor as rows and work units finish.
+// With a non-zero `delay`, DMA_DONE and the data interrupt are held back for
+// that many DMA service calls.
+void DMAChannel::Advance(u32 count, u32 delay) {
+    while (count > 0 && IsRunning()) {
+        u32 n = std::min<u32>(count, currXCount);
+        currAddr += n * xModify;
+        currXCount -= n;
+        count -= n;
+        stats.bytes += n * ElementBytes();
+        workUnitBytes += n * ElementBytes();
+
+        if (currXCount == 0) {
+            bool transferComplete = true;
+            bool interrupt = false;
+            if (mode2D) {
+                currYCount--;
+                if (currYCount > 0) {
+                    currXCount = xCount;
+                    currAddr = currAddr - xModify + yModify;
+                    transferComplete = false;
+                }
+            }
+            if (dataInterruptEnabled) {
+                if (!mode2D || mode2DInterruptEachRow) {
+                    interrupt = true;
+                } else if (currYCount == 0) {
+                    interrupt = true;
+                }
+            }
+            bool stop = transferComplete && next == DMANextOperation::Stop;
+            if (delay) {
+                // DMA_RUN stays set until DMA_DONE is delivered
+                pendingCompletions.push_back({dma.ServiceTick() + delay, transferComplete, interrupt, stop});
+                stopPending = stopPending || stop;
+            } else {
+                if (stop) running = false;
+                if (transferComplete) completed = true;
+                if (interrupt) RaiseDataInterrupt();
+            }
+            if (transferComplete) {
+                stats.transfers++;
+                if (dma.IsTimelineEnabled()) {
+                    dma.RecordEvent(index, DMAEventType::Complete, startAddr, workUnitBytes);
+                }
+                if (!stop) {
+                    ProcessDescriptor();
+                }
+                break;
+            }
+        }
+    }
+}
+
+void DMAChannel::DeliverInterrupts(u64 tick) {
+    while (!pendingCompletions.empty() && pendingCompletions.front().tick <= tick) {
+        auto pending = pendingCompletions.front();
+        pendingCompletions.pop_front();
+        if (pending.stop) {
+            running = false;
+            stopPending = false;
+        }
+        if (pending.done) completed = true;
+        if (pending.interrupt) RaiseDataInterrupt();
+    }
+}
+
 // Returns the number of bytes transferred in this call (0 if the channel is
 // idle, unattached, or blocked). MDMA channels are ordinary DMA channels
 // bound to a MemorySrcDMABus/MemoryDestDMABus pair (see dma.h) rather than a
 // special-cased transfer path.
+//
+// One call may span several rows of a 2D transfer: the peripheral still sees
+// one DMARead/DMAWrite per row with that row's (x, y), and the call stops at
+// the first short transfer or when the work unit completes.
 u32 DMAChannel::ProcessTransfer() {
-    if (!enabled || !running) return 0;
+    if (!enabled || !IsRunning()) return 0;
 
     auto bus = dma.GetDMABus(peripheralType);
     if (!bus) {
@@ -189,71 +381,69 @@ u32 DMAChannel::ProcessTransfer() {
         return 0;
     }
 
-    int elementBytes = 1 << wordSize;
-    u32 totalBytes = currXCount * elementBytes;
+    if (!bus->DMARequest(memoryWrite) || IsHeld()) return 0;
 
+    int elementBytes = 1 << wordSize;
     u8 buffer[4096];
-    totalBytes = std::min(totalBytes, (u32)sizeof(buffer));
-    dma.GetEmulator().Lock();
-    if (memoryWrite) {
-        totalBytes = bus->DMARead(xCount - currXCount, yCount - currYCount, buffer, totalBytes);
-        totalBytes -= totalBytes % elementBytes; // only write whole elements
-        if (xModify == elementBytes) {
-            dma.GetEmulator().MemoryWrite(currAddr, buffer, totalBytes);
-        } else {
-            u32 addr = currAddr;
-            for (u32 i = 0; i < totalBytes; i += elementBytes) {
-                dma.GetEmulator().MemoryWrite(addr, buffer + i, elementBytes);
-                addr += xModify;
+
+    // Zero-copy scanout: the peripheral reads a whole work unit from guest
+    // RAM itself. Completion is delayed, and the channel held, for as many
+    // service calls as staging it through `buffer` would have taken. Row
+    // interrupts (DI_SEL) need the rows to complete one by one, so those
+    // transfers take the staged path.
+    bool rowInterrupts = mode2D && mode2DInterruptEachRow && dataInterruptEnabled;
+    if (!memoryWrite && workUnitBytes == 0 && !rowInterrupts) {
+        u32 remaining = RemainingElements();
+        if (const u8* memory = MapElements(remaining)) {
+            dma.GetEmulator().Lock();
+            u32 count = bus->DMAScanout(memory, Walk(), remaining);
+            dma.GetEmulator().Unlock();
+            if (count) {
+                u32 delay = (u64)count * elementBytes / sizeof(buffer);
+                heldUntil = dma.ServiceTick() + delay;
+                Advance(count, delay);
+                return count * elementBytes;
             }
         }
+    }
+    u32 maxElements = std::min(RemainingElements(), (u32)sizeof(buffer) / elementBytes);
+
+    // Runs `transfer(offset, elements, x, y)` for each row segment of the
+    // next `maxElements` elements; it returns the elements it accepted.
+    auto forEachRow = [&](auto transfer) {
+        u32 done = 0;
+        u32 xLeft = currXCount;
+        u32 yLeft = currYCount;
+        while (done < maxElements) {
+            u32 n = std::min(xLeft, maxElements - done);
+            int x = xCount - xLeft;
+            int y = yCount - yLeft;
+            u32 accepted = transfer(done * elementBytes, n, x, y);
+            done += accepted;
+            if (accepted < n || !mode2D || yLeft <= 1) break;
+            xLeft = xCount;
+            yLeft--;
+        }
+        return done;
+    };
+
+    u32 count;
+    dma.GetEmulator().Lock();
+    if (memoryWrite) {
+        count = forEachRow([&](u32 offset, u32 n, int x, int y) {
+            return bus->DMARead(x, y, buffer + offset, n * elementBytes) / elementBytes; // only write whole elements
+        });
+        AccessMemory(buffer, count, true);
     } else {
         // Memory read (memory to peripheral)
-        if (xModify == elementBytes) {
-            dma.GetEmulator().MemoryRead(currAddr, buffer, totalBytes);
-        } else {
-            u32 addr = currAddr;
-            for (u32 i = 0; i < totalBytes; i += elementBytes) {
-                dma.GetEmulator().MemoryRead(addr, buffer + i, elementBytes);
-                addr += xModify;
-            }
-        }
-        totalBytes = bus->DMAWrite(xCount - currXCount, yCount - currYCount, buffer, totalBytes);
-        totalBytes -= totalBytes % elementBytes; // only count whole elements accepted
+        AccessMemory(buffer, maxElements, false);
+        count = forEachRow([&](u32 offset, u32 n, int x, int y) {
+            return bus->DMAWrite(x, y, buffer + offset, n * elementBytes) / elementBytes; // only count whole elements accepted
+        });
     }
     dma.GetEmulator().Unlock();
 
-    u32 count = totalBytes / elementBytes;
-    currAddr += count * xModify;
-    currXCount -= count;
-
-    if (currXCount == 0) {
-        bool transferComplete = true;
-        if (mode2D) {
-            currYCount--;
-            if (currYCount > 0) {
-                currXCount = xCount;
-                currAddr = currAddr - xModify + yModify;
-                transferComplete = false;
-            }
-        }
-        if (dataInterruptEnabled) {
-            if (!mode2D || mode2DInterruptEachRow) {
-                TriggerInterrupt(1);
-            } else if (currYCount == 0) {
-                TriggerInterrupt(1);
-            }
-        }
-        if (transferComplete) {
-            completed = true;
-            running = false;
-            if (next != DMANextOperation::Stop) {
-                running = true;
-                ProcessDescriptor();
-            }
-        }
-    }
-
+    Advance(count);
     return count * elementBytes;
 }
 
@@ -290,6 +480,7 @@ u32 MemoryDestDMABus::DMAWrite(int x, int y, const void* src, u32 length) {
 
 DMA::DMA(u32 baseAddr, Emulator& emu)
     : RegisterDevice("DMA", baseAddr, 0x400), emulator(emu)
+    , createdAt(std::chrono::steady_clock::now())
 {
     for (size_t i = 0; i < channels.size(); i++) {
         channels[i] = std::make_shared<DMAChannel>("DMAChannel" + std::to_string(i), baseAddr + i * 0x40, *this, i);
@@ -317,19 +508,86 @@ u32 DMA::Read32(u32 offset) {
 // bounded by FIFO capacity; MDMA_BURST_BYTES is just an extra guard against
 // FLOW=Autobuffer auto-restarting the transfer indefinitely.
 static constexpr u32 MDMA_BURST_BYTES = 4096;
+// Upper bound for one fast-path service call, so that circular descriptor
+// lists and autobuffer mode still yield back to the CPU.
+static constexpr u32 MDMA_SERVICE_BYTES = 16 << 20;
+
+DMAChannel* DMA::FindChannel(DMAPeripheralType type) {
+    for (auto& channel : channels) {
+        if (channel->GetPeripheralType() == type) return channel.get();
+    }
+    return nullptr;
+}
+
+// MDMA fast path: while both halves of a stream are running over RAM and the
+// FIFO is empty, copy straight from the source walk to the destination walk
+// on host pointers, following 2D rows, autobuffer restarts and descriptor
+// chains. Completions are delayed by one service call per MDMA_BURST_BYTES
+// moved so that interrupts arrive when the FIFO path would have raised them.
+u32 DMA::ProcessMemoryTransfer(DMAChannel& src, DMAChannel& dst) {
+    u8 buffer[4096];
+    u32 total = 0;
+    emulator.Lock();
+    while (src.IsEnabled() && src.IsRunning() && !src.IsMemoryWrite()
+           && dst.IsEnabled() && dst.IsRunning() && dst.IsMemoryWrite()
+           && total < MDMA_SERVICE_BYTES) {
+        int srcBytes = src.ElementBytes();
+        int dstBytes = dst.ElementBytes();
+        bool direct = src.IsContiguous() && dst.IsContiguous();
+        u64 bytes = std::min((u64)src.RemainingElements() * srcBytes, (u64)dst.RemainingElements() * dstBytes);
+        bytes = std::min<u64>(bytes, direct ? MDMA_SERVICE_BYTES - total : sizeof(buffer));
+        bytes -= bytes % std::max(srcBytes, dstBytes); // whole elements on both sides
+        if (bytes == 0) break;
+
+        u32 srcCount = bytes / srcBytes;
+        u32 dstCount = bytes / dstBytes;
+        u8* from = src.MapElements(srcCount);
+        u8* to = dst.MapElements(dstCount);
+        if (!from || !to) break;
+        if (direct) {
+            memmove(to, from, bytes);
+        } else {
+            DMAGather(buffer, from, src.Walk(), srcCount);
+            DMAScatter(to, buffer, dst.Walk(), dstCount);
+        }
+
+        total += bytes;
+        u32 delay = total / MDMA_BURST_BYTES;
+        src.Advance(srcCount, delay);
+        dst.Advance(dstCount, delay);
+    }
+    emulator.Unlock();
+    return total;
+}
 
 void DMA::ProcessWithInterrupt(int ivg) {
+    serviceTick++;
     for (auto& channel : channels) {
+        channel->DeliverInterrupts(serviceTick);
+    }
+    for (auto& channel : channels) {
+        bool active = channel->IsEnabled() && channel->IsRunning();
         if (!channel->IsMDMA()) {
-            channel->ProcessTransfer();
+            // A peripheral holding its request line low is idle, not stalled
+            if (!channel->ProcessTransfer() && active && channel->IsRequested() && !channel->IsHeld()) channel->CountStall();
             continue;
         }
         u32 total = 0;
-        while (total < MDMA_BURST_BYTES) {
+        if (channel->IsMDMASource()) {
+            auto type = channel->GetPeripheralType();
+            auto fifo = std::dynamic_pointer_cast<MemorySrcDMABus>(GetDMABus(type));
+            auto dest = FindChannel(static_cast<DMAPeripheralType>(type - 1));
+            if (fifo && fifo->IsEmpty() && dest) {
+                total += ProcessMemoryTransfer(*channel, *dest);
+            }
+        }
+        u32 burst = 0;
+        while (burst < MDMA_BURST_BYTES) {
             u32 moved = channel->ProcessTransfer();
             if (!moved) break;
-            total += moved;
+            burst += moved;
         }
+        if (!total && !burst && active) channel->CountStall();
     }
 }
 
@@ -337,4 +595,54 @@ void DMA::BindInterrupt(int channel, int q, InterruptHandler callback) {
     if (channel >= 0 && channel < static_cast<int>(channels.size())) {
         channels[channel]->BindInterrupt(q, callback);
     }
-}
\ No newline at end of file
+}
+
+const DMAChannelStats& DMA::GetChannelStats(int channel) const {
+    return channels.at(channel)->Stats();
+}
+
+void DMA::EnableTimeline(size_t capacity) {
+    timeline.clear();
+    timeline.reserve(capacity);
+    timelineCapacity = capacity;
+    timelineHead = 0;
+}
+
+void DMA::RecordEvent(int channel, DMAEventType type, u32 addr, u32 bytes) {
+    if (!timelineCapacity) return;
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - createdAt).count();
+    DMATimelineEvent event{serviceTick, (u64)micros, (u8)channel, type, addr, bytes};
+    if (timeline.size() < timelineCapacity) {
+        timeline.push_back(event);
+    } else {
+        timeline[timelineHead] = event;
+        timelineHead = (timelineHead + 1) % timelineCapacity;
+    }
+}
+
+void DMA::WriteStatistics(std::ostream& out) const {
+    out << "{\n  \"tick\": " << serviceTick << ",\n  \"channels\": [";
+    for (size_t i = 0; i < channels.size(); i++) {
+        const auto& channel = *channels[i];
+        const auto& stats = channel.Stats();
+        out << (i ? "," : "") << "\n    {\"channel\": " << i
+            << ", \"name\": \"" << channel.Name() << "\""
+            << ", \"peripheral\": " << (int)channel.GetPeripheralType()
+            << ", \"bytes\": " << stats.bytes
+            << ", \"transfers\": " << stats.transfers
+            << ", \"descriptors\": " << stats.descriptors
+            << ", \"stalls\": " << stats.stalls
+            << ", \"interrupts\": " << stats.interrupts << "}";
+    }
+    out << "\n  ],\n  \"timeline\": [";
+    for (size_t i = 0; i < timeline.size(); i++) {
+        const auto& event = timeline[(timelineHead + i) % timeline.size()];
+        out << (i ? "," : "") << "\n    {\"tick\": " << event.tick
+            << ", \"time_us\": " << event.hostMicros
+            << ", \"channel\": " << (int)event.channel
+            << ", \"event\": \"" << (event.type == DMAEventType::Start ? "start" : "complete") << "\""
+            << ", \"addr\": " << event.addr
+            << ", \"bytes\": " << event.bytes << "}";
+    }
+    out << "\n  ]\n}\n";
+}
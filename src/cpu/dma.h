@@ -5,8 +5,11 @@
 #include <vector>
 #include <map>
 #include <memory>
+#include <ostream>
+#include <chrono>
 
 class Bus;
+struct DMAWalk;
 
 class DMABus {
 public:
@@ -17,6 +20,17 @@ public:
     // Discard any buffered data. MDMA's internal FIFO is flushed when a new
     // transfer starts; peripheral buses ignore this.
     virtual void DMAFlush() {}
+    // Peripheral DMA request line for the given direction (memoryWrite: data
+    // flows from the peripheral into memory). While it is deasserted the
+    // channel skips its service call instead of staging data for a bus that
+    // would refuse it.
+    virtual bool DMARequest(bool memoryWrite) { return true; }
+    // Zero-copy alternative to DMAWrite for memory-to-peripheral channels.
+    // `memory` is the host pointer of the current element and the rest of
+    // the work unit, `elements` elements laid out as `walk`, is page-mapped
+    // RAM. Returns the number of elements consumed straight from memory, or
+    // 0 to have them staged and sent through DMAWrite as usual.
+    virtual u32 DMAScanout(const u8* memory, const DMAWalk& walk, u32 elements) { return 0; }
 };
 
 // MDMA source/destination channels are just two ordinary DMA channels
@@ -31,6 +45,7 @@ public:
     u32 DMARead(int x, int y, void* dest, u32 length) override;
     u32 DMAWrite(int x, int y, const void* source, u32 length) override;
     void DMAFlush() override { head = tail = 0; }
+    bool IsEmpty() const { return head == tail; }
 
 protected:
     static constexpr u32 CAPACITY = 4096; // matches ProcessTransfer's staging buffer
@@ -69,6 +84,29 @@ enum DMAPeripheralType {
     DMAPeripheralMDMASrc1 = 0xF,
 };
 
+// Per-channel counters, reported by DMA::WriteStatistics().
+struct DMAChannelStats {
+    u64 bytes = 0;       // bytes moved to or from memory
+    u64 transfers = 0;   // completed work units
+    u64 descriptors = 0; // descriptors fetched from memory
+    u64 stalls = 0;      // service calls where the bus accepted/returned nothing
+    u64 interrupts = 0;  // data interrupts raised
+};
+
+enum class DMAEventType : u8 {
+    Start,    // work unit loaded (CONFIG write or next descriptor)
+    Complete, // last element of the work unit moved
+};
+
+struct DMATimelineEvent {
+    u64 tick;       // DMA service call, see DMA::ServiceTick()
+    u64 hostMicros; // host time since the DMA controller was created
+    u8 channel;
+    DMAEventType type;
+    u32 addr;       // START_ADDR of the work unit
+    u32 bytes;      // bytes moved by the work unit (Complete only)
+};
+
 class DMAChannel;
 class DMA : public RegisterDevice {
 public:
@@ -82,14 +120,33 @@ public:
 
     std::shared_ptr<DMABus> GetDMABus(DMAPeripheralType type) { return dmaBuses[type]; }
     Emulator& GetEmulator() { return emulator; }
+    // Number of ProcessWithInterrupt calls so far; the timebase for deferred
+    // MDMA completions.
+    u64 ServiceTick() const { return serviceTick; }
 
     u32 Read32(u32 offset) override;
     void Write32(u32 offset, u32 value) override;
 
     void ProcessWithInterrupt(int ivg) override;
 
+    const DMAChannelStats& GetChannelStats(int channel) const;
+    // Keep the last `capacity` start/complete events; 0 disables the timeline.
+    void EnableTimeline(size_t capacity);
+    bool IsTimelineEnabled() const { return timelineCapacity != 0; }
+    void RecordEvent(int channel, DMAEventType type, u32 addr, u32 bytes);
+    // Counters for every channel plus the timeline, as a JSON document.
+    void WriteStatistics(std::ostream& out) const;
+
 protected:
+    DMAChannel* FindChannel(DMAPeripheralType type);
+    u32 ProcessMemoryTransfer(DMAChannel& src, DMAChannel& dst);
+
     Emulator& emulator;
+    u64 serviceTick = 0;
+    std::chrono::steady_clock::time_point createdAt;
+    std::vector<DMATimelineEvent> timeline;
+    size_t timelineCapacity = 0;
+    size_t timelineHead = 0; // oldest event once the ring has wrapped
     std::array<std::shared_ptr<DMAChannel>, 16> channels;
     std::map<DMAPeripheralType, std::shared_ptr<DMABus>> dmaBuses;
 };
\ No newline at end of file
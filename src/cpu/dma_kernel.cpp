@@ -0,0 +1,141 @@
+#include "dma_kernel.h"
+#include <algorithm>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+void DMAWalkSpan(const DMAWalk& walk, u32 addr, u32 count, u32& lo, u32& length)
+{
+    u32 low = addr, high = addr;
+    u32 xLeft = walk.xLeft;
+    while (count > 0) {
+        u32 n = std::min(count, xLeft);
+        u32 last = addr + (n - 1) * walk.xModify;
+        low = std::min({low, addr, last});
+        high = std::max({high, addr, last});
+        count -= n;
+        addr = last + walk.yModify;
+        xLeft = walk.xCount;
+    }
+    lo = low;
+    length = high - low + walk.elementBytes;
+}
+
+// Strided copies of one row. Elements are moved whole with memcpy so the
+// scalar paths never assume host alignment of guest buffers.
+template <typename T>
+static void GatherRow(u8* dest, const u8* src, int stride, u32 n)
+{
+    u32 i = 0;
+#if defined(__SSE2__)
+    // Every other element, e.g. one channel of an interleaved stereo buffer.
+    // Blocks stop before the final element so loads never run past the span.
+    if (sizeof(T) >= 2 && stride == 2 * (int)sizeof(T)) {
+        constexpr u32 lanes = 16 / sizeof(T);
+        for (; i + lanes < n; i += lanes) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(src + i * stride));
+            __m128i b = _mm_loadu_si128((const __m128i*)(src + i * stride + 16));
+            __m128i v;
+            if (sizeof(T) == 2) {
+                a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+                b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+                v = _mm_packs_epi32(a, b);
+            } else {
+                v = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(2, 0, 2, 0)));
+            }
+            _mm_storeu_si128((__m128i*)(dest + i * sizeof(T)), v);
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        memcpy(dest + i * sizeof(T), src + (ptrdiff_t)i * stride, sizeof(T));
+    }
+}
+
+template <typename T>
+static void ScatterRow(u8* dest, const u8* src, int stride, u32 n)
+{
+    u32 i = 0;
+#if defined(__SSE2__)
+    // Read-modify-write keeps the interleaved neighbour elements intact.
+    if (sizeof(T) >= 2 && stride == 2 * (int)sizeof(T)) {
+        constexpr u32 lanes = 16 / sizeof(T);
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i keep = sizeof(T) == 2 ? _mm_set1_epi32((int)0xFFFF0000) : _mm_set_epi32(-1, 0, -1, 0);
+        for (; i + lanes < n; i += lanes) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(src + i * sizeof(T)));
+            __m128i lo, hi;
+            if (sizeof(T) == 2) {
+                lo = _mm_unpacklo_epi16(v, zero);
+                hi = _mm_unpackhi_epi16(v, zero);
+            } else {
+                lo = _mm_unpacklo_epi32(v, zero);
+                hi = _mm_unpackhi_epi32(v, zero);
+            }
+            u8* d = dest + i * stride;
+            __m128i a = _mm_loadu_si128((const __m128i*)d);
+            __m128i b = _mm_loadu_si128((const __m128i*)(d + 16));
+            _mm_storeu_si128((__m128i*)d, _mm_or_si128(_mm_and_si128(a, keep), lo));
+            _mm_storeu_si128((__m128i*)(d + 16), _mm_or_si128(_mm_and_si128(b, keep), hi));
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        memcpy(dest + (ptrdiff_t)i * stride, src + i * sizeof(T), sizeof(T));
+    }
+}
+
+template <typename T>
+static void Gather(u8* dest, const u8* memory, const DMAWalk& walk, u32 count)
+{
+    u32 xLeft = walk.xLeft;
+    while (count > 0) {
+        u32 n = std::min(count, xLeft);
+        if (walk.xModify == (int)sizeof(T)) {
+            memcpy(dest, memory, n * sizeof(T));
+        } else {
+            GatherRow<T>(dest, memory, walk.xModify, n);
+        }
+        dest += n * sizeof(T);
+        memory += (ptrdiff_t)(n - 1) * walk.xModify + walk.yModify;
+        count -= n;
+        xLeft = walk.xCount;
+    }
+}
+
+template <typename T>
+static void Scatter(u8* memory, const u8* source, const DMAWalk& walk, u32 count)
+{
+    u32 xLeft = walk.xLeft;
+    while (count > 0) {
+        u32 n = std::min(count, xLeft);
+        if (walk.xModify == (int)sizeof(T)) {
+            memcpy(memory, source, n * sizeof(T));
+        } else {
+            ScatterRow<T>(memory, source, walk.xModify, n);
+        }
+        source += n * sizeof(T);
+        memory += (ptrdiff_t)(n - 1) * walk.xModify + walk.yModify;
+        count -= n;
+        xLeft = walk.xCount;
+    }
+}
+
+void DMAGather(u8* dest, const u8* memory, const DMAWalk& walk, u32 count)
+{
+    switch (walk.elementBytes) {
+    case 1: Gather<u8>(dest, memory, walk, count); break;
+    case 2: Gather<u16>(dest, memory, walk, count); break;
+    case 4: Gather<u32>(dest, memory, walk, count); break;
+    }
+}
+
+void DMAScatter(u8* memory, const u8* source, const DMAWalk& walk, u32 count)
+{
+    switch (walk.elementBytes) {
+    case 1: Scatter<u8>(memory, source, walk, count); break;
+    case 2: Scatter<u16>(memory, source, walk, count); break;
+    case 4: Scatter<u32>(memory, source, walk, count); break;
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "common.h"
+
+// Element walk of a DMA work unit over guest memory: rows of `xCount`
+// elements, `xModify` bytes between elements of a row and `yModify` bytes
+// from the last element of a row to the first element of the next one.
+// `xLeft` is the number of elements remaining in the current row.
+struct DMAWalk {
+    int elementBytes;
+    int xModify;
+    int yModify;
+    u32 xCount;
+    u32 xLeft;
+};
+
+// Returns the lowest guest address touched by `count` elements of `walk`
+// starting at `addr`, and the length of the covered range in bytes.
+void DMAWalkSpan(const DMAWalk& walk, u32 addr, u32 count, u32& lo, u32& length);
+
+// Gather/scatter `count` elements between a packed staging buffer and host
+// memory laid out as described by `walk`. `memory` points at the host copy of
+// the first element; rows wrap with `yModify` inside the kernel.
+void DMAGather(u8* dest, const u8* memory, const DMAWalk& walk, u32 count);
+void DMAScatter(u8* memory, const u8* source, const DMAWalk& walk, u32 count);
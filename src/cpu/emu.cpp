@@ -155,6 +155,26 @@ void* Emulator::MemoryMap(u32 addr)
     }
 }
 
+u8* Emulator::MemoryMapRange(u32 addr, u32 length)
+{
+    if (length == 0 || (u64)addr + length > (1ULL << 32)) {
+        return nullptr;
+    }
+    auto& table = *pageTable;
+    u32 first = addr >> PAGE_BITS;
+    u32 last = (addr + length - 1) >> PAGE_BITS;
+    u8* base = table[first];
+    if (!base) {
+        return nullptr;
+    }
+    for (u32 page = first + 1; page <= last; page++) {
+        if (table[page] != base + ((size_t)(page - first) << PAGE_BITS)) {
+            return nullptr;
+        }
+    }
+    return base + (addr & ((1 << PAGE_BITS) - 1));
+}
+
 bool Emulator::IsMemoryValid(u32 addr)
 {
     return get_device(addr, deviceSegments) != nullptr;
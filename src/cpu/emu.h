@@ -52,6 +52,9 @@ public:
     bool MemoryWriteExclusive32(u32 vaddr, u32 value, u32 expected);
 
     void* MemoryMap(u32 addr);
+    // Host pointer for [addr, addr + length) if the whole range is page-mapped
+    // memory that is contiguous on the host, nullptr otherwise.
+    u8* MemoryMapRange(u32 addr, u32 length);
 
     std::array<u8*, NUM_PAGE_TABLE_ENTRIES>& PageTable() { return *pageTable; }
     FastMem& GetFastMem() { return *fastmem; }
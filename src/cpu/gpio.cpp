@@ -187,6 +187,34 @@ bool GPIO::SetPinInput(int pin, GPIOPinLevel level) {
     return true;
 }
 
+// SetPinInput() for several pins at once, with the same data and interrupt
+// state updates
+void GPIO::SetPortInput(u32 levels, u32 mask) {
+    u16 pins = mask & ~dir_output & inen;
+    if (!pins) {
+        return;
+    }
+
+    u16 oldLevels = data ^ polar_active_low;
+    u16 newLevels = levels;
+    data = (data & ~pins) | ((newLevels ^ polar_active_low) & pins);
+
+    // Edge triggered: both edges, or the edge matching the polarity
+    u16 changed = (oldLevels ^ newLevels) & pins;
+    u16 rising = changed & newLevels;
+    u16 falling = changed & oldLevels;
+    u16 triggered = pins & edge & ((both & changed) | (~both & ~polar_active_low & rising) | (~both & polar_active_low & falling));
+    intState |= triggered;
+
+    // Level triggered: pending while the pin is low
+    u16 levelPins = pins & ~edge;
+    intState = (intState & ~levelPins) | (~newLevels & levelPins);
+
+    if (triggered || levelPins) {
+        ForwardInterrupts();
+    }
+}
+
 void GPIO::ForwardInterrupts() {
     ForwardInterrupt(irqA, maskA);
     ForwardInterrupt(irqB, maskB);
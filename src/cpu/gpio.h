@@ -32,6 +32,27 @@ public:
 
     virtual int GetPinCount() const = 0;
 
+    // Whole-port access for parallel buses: bit n is the level of pin n
+    // (1 = High). The defaults go pin by pin; ports override them to move
+    // the word in one call.
+    virtual u32 GetPortOutput() const {
+        u32 levels = 0;
+        for (int pin = 0; pin < GetPinCount(); pin++) {
+            if (GetPinOutput(pin) == GPIOPinLevel::High) {
+                levels |= 1u << pin;
+            }
+        }
+        return levels;
+    }
+    // Drives the pins selected by `mask` to `levels`
+    virtual void SetPortInput(u32 levels, u32 mask) {
+        for (int pin = 0; pin < GetPinCount(); pin++) {
+            if (mask & (1u << pin)) {
+                SetPinInput(pin, (levels >> pin) & 1 ? GPIOPinLevel::High : GPIOPinLevel::Low);
+            }
+        }
+    }
+
     virtual void Connect(int pin, GPIOConnection otherConn) {
         auto& [other, otherPin] = otherConn;
         connections[pin][&other].push_back(otherPin);
@@ -120,6 +141,8 @@ public:
     bool SetPinInput(int pin, GPIOPinLevel level) override;
     GPIOPinLevel GetPinOutput(int pin) const override;
     int GetPinCount() const override;
+    u32 GetPortOutput() const override { return (u16)(data ^ polar_active_low); }
+    void SetPortInput(u32 levels, u32 mask) override;
 
 private:
     void ForwardInterrupts();
@@ -133,36 +133,89 @@ u32 NFC::DMAWrite(int x, int y, const void* source, u32 length)
     return len;
 }
 
-static std::tuple<u16, u16> ComputeEccPair(const u8* data, u32 length, u32 bytePos) {
-    u8 p1 = 0, p1p = 0, p2 = 0, p2p = 0, p4 = 0, p4p = 0;
-    u8 lp[8] = {0};
-    u8 lpp[8] = {0};
-    for (u32 i = 0; i < length; i++) {
-        u8 d = data[i];
-        u8 byteParity = 0;
+// Per-byte lookup tables for ComputeEccPair
+struct EccTables {
+    // Parity of the byte
+    u8 parity[256];
+    // Column parities of the XOR of all bytes: bits 0-2 are P1, P2, P4 of
+    // the first ECC word, bits 3-5 P1', P2', P4' of the second. P2 and P2'
+    // follow the controller, which folds every bit into P2.
+    u8 column[256];
+    // For a mask of the odd-parity bytes in 8 consecutive bytes: bits 0-2
+    // are the XOR of their indexes, bit 3 is set for an odd count
+    u8 lanes[256];
+};
+
+static constexpr EccTables MakeEccTables() {
+    EccTables tables = {};
+    for (int value = 0; value < 256; value++) {
+        u8 p1 = 0, p1p = 0, p2 = 0, p2p = 0, p4 = 0, p4p = 0, parity = 0, lanes = 0;
         for (int pos = 0; pos < 8; pos++) {
-            u8 bit = (d >> pos) & 1;
+            u8 bit = (value >> pos) & 1;
             if (pos & 0x1) p1 ^= bit;
             else           p1p ^= bit;
             if (pos & 0x2) p2 ^= bit;
             else           p2 ^= bit;
             if (pos & 0x4) p4 ^= bit;
             else           p4p ^= bit;
-            byteParity ^= bit;
+            parity ^= bit;
+            if (bit) {
+                lanes ^= pos;
+            }
         }
+        tables.parity[value] = parity;
+        tables.column[value] = p1 | (p2 << 1) | (p4 << 2) | (p1p << 3) | (p2p << 4) | (p4p << 5);
+        tables.lanes[value] = lanes | (parity << 3);
+    }
+    return tables;
+}
 
-        u32 currentBytePos = bytePos + i;
-        for (int pos = 0; pos < 8; pos++) {
-            if (currentBytePos & (1 << pos)) {
-                lp[pos] ^= byteParity;
-            } else {
-                lpp[pos] ^= byteParity;
-            }
+static constexpr EccTables ECC_TABLES = MakeEccTables();
+
+// Hamming ECC of `length` bytes, the first at byte `bytePos` of the 256-byte
+// ECC block. Column parities only depend on the XOR of all bytes, and line
+// parities on the XOR of the positions of the odd-parity bytes, so both are
+// accumulated 8 bytes at a time once the position is 8-aligned.
+std::tuple<u16, u16> NFC::ComputeEccPair(const u8* data, u32 length, u32 bytePos) {
+    u64 folded = 0; // XOR of all bytes, in 8 lanes
+    u8 lines = 0;   // XOR of the positions of odd-parity bytes
+    u32 i = 0;
+    for (; i < length && ((bytePos + i) & 7); i++) {
+        folded ^= data[i];
+        if (ECC_TABLES.parity[data[i]]) {
+            lines ^= bytePos + i;
         }
     }
-    u16 ecc1 = (p1 << 0) | (p2 << 1) | (p4 << 2) | (lp[0] << 3) | (lp[1] << 4) | (lp[2] << 5) | (lp[3] << 6) | (lp[4] << 7) | (lp[5] << 8) | (lp[6] << 9) | (lp[7] << 10);
-    u16 ecc2 = (p1p << 0) | (p2p << 1) | (p4p << 2) | (lpp[0] << 3) | (lpp[1] << 4) | (lpp[2] << 5) | (lpp[3] << 6) | (lpp[4] << 7) | (lpp[5] << 8) | (lpp[6] << 9) | (lpp[7] << 10);
-    return {ecc1 & 0x7FF, ecc2 & 0x7FF};
+    for (; i + 8 <= length; i += 8) {
+        u64 word;
+        std::memcpy(&word, data + i, sizeof(word));
+        folded ^= word;
+        // Parity of each byte into bit 0 of its lane, then the 8 lane bits
+        // gathered into the top byte (byte j of the word is lane j)
+        u64 parity = word ^ (word >> 4);
+        parity ^= parity >> 2;
+        parity ^= parity >> 1;
+        u8 mask = ((parity & 0x0101010101010101ull) * 0x0102040810204080ull) >> 56;
+        u8 lanes = ECC_TABLES.lanes[mask];
+        lines ^= (lanes & 7) | ((lanes & 8) ? (bytePos + i) & 0xF8 : 0);
+    }
+    for (; i < length; i++) {
+        folded ^= data[i];
+        if (ECC_TABLES.parity[data[i]]) {
+            lines ^= bytePos + i;
+        }
+    }
+
+    folded ^= folded >> 32;
+    folded ^= folded >> 16;
+    folded ^= folded >> 8;
+    u8 x = static_cast<u8>(folded);
+    // Each line parity pair covers every odd-parity byte once
+    u8 complement = ECC_TABLES.parity[x] ? 0xFF : 0x00;
+    u8 column = ECC_TABLES.column[x];
+    u16 ecc1 = (column & 7) | (lines << 3);
+    u16 ecc2 = (column >> 3) | (static_cast<u8>(lines ^ complement) << 3);
+    return {ecc1, ecc2};
 }
 
 void NFC::CalculateECC(const u8* data, u32 length) {
@@ -4,6 +4,7 @@
 #include "dma.h"
 #include <vector>
 #include <functional>
+#include <tuple>
 
 class NandFlash {
 public:
@@ -41,6 +42,10 @@ public:
 
     void ProcessWithInterrupt(int ivg) override;
 
+    // The two ECC words of `length` bytes, the first at byte `bytePos` of
+    // a 256-byte ECC block
+    static std::tuple<u16, u16> ComputeEccPair(const u8* data, u32 length, u32 bytePos);
+
 protected:
     u32 PageSize() const { return (pageSize == 0) ? 256 : 512; }
     void ResetECC();
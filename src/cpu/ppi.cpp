@@ -1,4 +1,5 @@
 #include "ppi.h"
+#include "dma_kernel.h"
 #include "peripheral/display.h"
 
 enum PPIOutputType {
@@ -51,5 +52,32 @@ PPI::PPI(u32 baseAddr) : RegisterDevice("PPI", baseAddr, 0x14) {
 
 u32 PPI::DMAWrite(int x, int y, const void* source, u32 length) {
     display->UpdateRowBuffer(x, y, source, length);
+    // A PPI frame is always lineCount full rows of 16-bit pixels
+    if (y + 1 == lineCount && x + length / sizeof(u16) >= rowCount + 1u) {
+        display->FrameComplete();
+    }
     return length;
-}
\ No newline at end of file
+}
+
+// Hands whole frames of 16-bit pixels to the display as a pointer into guest
+// RAM. Anything else (partial frames, non-contiguous rows, bottom-up
+// strides) is left to DMAWrite.
+u32 PPI::DMAScanout(const u8* memory, const DMAWalk& walk, u32 elements) {
+    u32 width = rowCount + 1u;
+    if (!display || walk.elementBytes != sizeof(u16) || walk.xModify != sizeof(u16)
+        || walk.xLeft != walk.xCount || elements != width * lineCount) {
+        return 0;
+    }
+    int stride;
+    if (walk.xCount == width) {
+        stride = (width - 1) * walk.xModify + walk.yModify; // 2D, one DMA row per line
+    } else if (walk.xCount == elements) {
+        stride = width * sizeof(u16); // 1D, the frame is one run
+    } else {
+        return 0;
+    }
+    if (stride < (int)(width * sizeof(u16)) || !display->ScanoutFrame(memory, stride)) {
+        return 0;
+    }
+    return elements;
+}
@@ -1,6 +1,8 @@
 #include "sport.h"
 #include "emu.h"
 #include "utils/log.h"
+#include <algorithm>
+#include <cstring>
 
 enum DataFormat {
     NORMAL = 0,
@@ -10,13 +12,22 @@ enum DataFormat {
 
 constexpr std::size_t FIFO_SIZE = 8; // 8x16-bit words or 4x32-bit words
 
+constexpr u64 CCLK_HZ = 400'000'000; // core clock, see BlackFinCpu::Run
+constexpr u64 SCLK_HZ = 100'000'000; // system clock, CCLK / 4
+// Frame rate of an externally clocked SPORT (the codec is clock master)
+constexpr u32 EXTERNAL_FRAME_RATE = 48000;
+// Frames the SPORT waits for before raising its next DMA request
+constexpr u64 REQUEST_FRAMES = 32;
+
 SPORT::SPORT(u32 baseAddr, int sportNum)
     : RegisterDevice("SPORT" + std::to_string(sportNum), baseAddr, 0x60), sportNumber(sportNum) {
 
     REG32(SPORT_TCR1, 0x00);
     FIELD(SPORT_TCR1, TSPEN, 0, 1, R(transmitEnabled), W(transmitEnabled));
+    FIELD(SPORT_TCR1, ITCLK, 1, 1, R(transmitInternalClock), W(transmitInternalClock));
     FIELD(SPORT_TCR1, TDTYPE, 2, 2, R(transmitDataFormat), W(transmitDataFormat));
     FIELD(SPORT_TCR1, TLSBIT, 4, 1, R(transmitOrderLsbFirst), W(transmitOrderLsbFirst));
+    FIELD(SPORT_TCR1, ITFS, 9, 1, R(transmitInternalFrameSync), W(transmitInternalFrameSync));
     SPORT_TCR1.writeCallback = [this](u32 value) {
         SetTransmitEnable();
     };
@@ -29,6 +40,12 @@ SPORT::SPORT(u32 baseAddr, int sportNum)
     FIELD(SPORT_TCR2, TXSE, 9, 1, R(transmitSecondaryEnabled), W(transmitSecondaryEnabled));
     FIELD(SPORT_TCR2, TRFST, 10, 1, R(transmitRightStereoOrderFirst), W(transmitRightStereoOrderFirst));
 
+    REG32(SPORT_TCLKDIV, 0x08);
+    FIELD(SPORT_TCLKDIV, VAL, 0, 16, R(transmitClockDivider), W(transmitClockDivider));
+
+    REG32(SPORT_TFSDIV, 0x0C);
+    FIELD(SPORT_TFSDIV, VAL, 0, 16, R(transmitFrameSyncDivider), W(transmitFrameSyncDivider));
+
     REG32(SPORT_TX, 0x10);
     SPORT_TX.writeCallback = [this](u32 v) {
         std::size_t fifoSize = transmitWordLength > 16 ? FIFO_SIZE/2 : FIFO_SIZE;
@@ -53,8 +70,10 @@ SPORT::SPORT(u32 baseAddr, int sportNum)
 
     REG32(SPORT_RCR1, 0x20);
     FIELD(SPORT_RCR1, RSPEN, 0, 1, R(receiveEnabled), W(receiveEnabled));
+    FIELD(SPORT_RCR1, IRCLK, 1, 1, R(receiveInternalClock), W(receiveInternalClock));
     FIELD(SPORT_RCR1, RDTYPE, 2, 2, R(receiveDataFormat), W(receiveDataFormat));
     FIELD(SPORT_RCR1, RLSBIT, 4, 1, R(receiveOrderLsbFirst), W(receiveOrderLsbFirst));
+    FIELD(SPORT_RCR1, IRFS, 9, 1, R(receiveInternalFrameSync), W(receiveInternalFrameSync));
     SPORT_RCR1.writeCallback = [this](u32 value) {
         SetReceiveEnable();
     };
@@ -67,6 +86,12 @@ SPORT::SPORT(u32 baseAddr, int sportNum)
     FIELD(SPORT_RCR2, RXSE, 9, 1, R(receiveSecondaryEnabled), W(receiveSecondaryEnabled));
     FIELD(SPORT_RCR2, RRFST, 10, 1, R(receiveRightStereoOrderFirst), W(receiveRightStereoOrderFirst));
 
+    REG32(SPORT_RCLKDIV, 0x28);
+    FIELD(SPORT_RCLKDIV, VAL, 0, 16, R(receiveClockDivider), W(receiveClockDivider));
+
+    REG32(SPORT_RFSDIV, 0x2C);
+    FIELD(SPORT_RFSDIV, VAL, 0, 16, R(receiveFrameSyncDivider), W(receiveFrameSyncDivider));
+
     REG32(SPORT_STAT, 0x30);
     FIELD(SPORT_STAT, RXNE, 0, 1, R(!receiveFifo.empty()), N());
     FIELD(SPORT_STAT, RUVF, 1, 1, R(receiveUnderflow), W1C(receiveUnderflow));
@@ -82,8 +107,10 @@ void SPORT::SetTransmitEnable() {
         transmitOverflow = false;
         transmitUnderflow = false;
         transmitHoldRegister.reset();
-        dmaTxActive_ = false;
-        totalTxSamplesDelivered_ = 0;
+        FrameCounts counts = ClockFrameCounts(transmitClock, TransmitFrameRate());
+        transmitTotals.delivered += counts.delivered;
+        transmitTotals.expected += counts.expected;
+        transmitClock = SampleClock();
     }
 }
 
@@ -92,9 +119,89 @@ void SPORT::SetReceiveEnable() {
         receiveOverflow = false;
         receiveUnderflow = false;
         receiveHoldRegister.reset();
-        dmaRxActive_ = false;
-        totalRxSamplesDelivered_ = 0;
+        FrameCounts counts = ClockFrameCounts(receiveClock, ReceiveFrameRate());
+        receiveTotals.delivered += counts.delivered;
+        receiveTotals.expected += counts.expected;
+        receiveClock = SampleClock();
+    }
+}
+
+// With internal clock and frame sync the frame rate follows the dividers:
+// SCLK / (2 * (CLKDIV + 1)) serial clock, one frame every FSDIV + 1 bits.
+static u32 FrameRate(bool internalClock, bool internalFrameSync, u16 clockDivider, u16 frameSyncDivider)
+{
+    if (!internalClock || !internalFrameSync) {
+        return EXTERNAL_FRAME_RATE;
+    }
+    u64 serialClock = SCLK_HZ / (2 * ((u64)clockDivider + 1));
+    return std::max<u64>(1, serialClock / ((u64)frameSyncDivider + 1));
+}
+
+u32 SPORT::TransmitFrameRate() const {
+    return FrameRate(transmitInternalClock, transmitInternalFrameSync, transmitClockDivider, transmitFrameSyncDivider);
+}
+
+u32 SPORT::ReceiveFrameRate() const {
+    return FrameRate(receiveInternalClock, receiveInternalFrameSync, receiveClockDivider, receiveFrameSyncDivider);
+}
+
+// Frames of `rate` per second in `elapsed` cycles, and the cycles it takes
+// for `frames` frames to come due. Whole seconds are carried separately so
+// that neither product overflows at the highest divider rates.
+static u64 CyclesToFrames(u64 elapsed, u32 rate) {
+    return elapsed / CCLK_HZ * rate + elapsed % CCLK_HZ * rate / CCLK_HZ;
+}
+
+static u64 FramesToCycles(u64 frames, u32 rate) {
+    return frames / rate * CCLK_HZ + (frames % rate * CCLK_HZ + rate - 1) / rate;
+}
+
+// Frames that have come due on `clock` by the current cycle, starting the
+// clock on the first transfer after the SPORT was enabled.
+u64 SPORT::FramesDue(SampleClock& clock, u32 rate) {
+    if (!clock.active) {
+        clock.active = true;
+        clock.startCycle = cycles;
+        clock.delivered = 0;
     }
+    u64 due = CyclesToFrames(cycles - clock.startCycle, rate);
+    return due > clock.delivered ? due - clock.delivered : 0;
+}
+
+SPORT::FrameCounts SPORT::ClockFrameCounts(const SampleClock& clock, u32 rate) const {
+    FrameCounts counts;
+    if (clock.active) {
+        counts.delivered = clock.delivered;
+        counts.expected = CyclesToFrames(cycles - clock.startCycle, rate);
+    }
+    return counts;
+}
+
+SPORT::FrameCounts SPORT::TransmitFrameCounts() const {
+    FrameCounts counts = ClockFrameCounts(transmitClock, TransmitFrameRate());
+    counts.delivered += transmitTotals.delivered;
+    counts.expected += transmitTotals.expected;
+    return counts;
+}
+
+SPORT::FrameCounts SPORT::ReceiveFrameCounts() const {
+    FrameCounts counts = ClockFrameCounts(receiveClock, ReceiveFrameRate());
+    counts.delivered += receiveTotals.delivered;
+    counts.expected += receiveTotals.expected;
+    return counts;
+}
+
+// Deasserts the DMA request until `frames` more frames are due.
+void SPORT::ScheduleRequest(SampleClock& clock, u32 rate, u64 frames) {
+    u64 frame = clock.delivered + frames;
+    clock.nextRequest = clock.startCycle + FramesToCycles(frame, rate);
+}
+
+bool SPORT::DMARequest(bool memoryWrite) {
+    if (memoryWrite) {
+        return receiveEnabled && cycles >= receiveClock.nextRequest;
+    }
+    return transmitEnabled && cycles >= transmitClock.nextRequest;
 }
 
 u32 SPORT::DMARead(int x, int y, void* dest, u32 length)
@@ -110,33 +217,17 @@ u32 SPORT::DMARead(int x, int y, void* dest, u32 length)
     size_t requestedSamples = length / frameSize;
     if (requestedSamples == 0) return 0;
 
-    // Start timing on first DMA call after SPORT enable
-    if (!dmaRxActive_) {
-        dmaRxStartTime_ = std::chrono::steady_clock::now();
-        totalRxSamplesDelivered_ = 0;
-        dmaRxActive_ = true;
-    }
-
-    // How many samples are due based on elapsed time?
-    auto elapsed = std::chrono::steady_clock::now() - dmaRxStartTime_;
-    uint64_t elapsedNs = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
-    uint64_t totalDue = (elapsedNs * sampleRateHz_) / 1'000'000'000ULL;
-    // FIXME: too slow, / 10
-    totalDue = totalDue / 10;
-    uint64_t available = (totalDue > totalRxSamplesDelivered_)
-                         ? (totalDue - totalRxSamplesDelivered_) : 0;
-
-    if (available > requestedSamples) available = requestedSamples;
-    if (available == 0) return 0;  // Not time yet — DMA retries next cycle
-
-    if (audioInputCallback) {
-        size_t read = audioInputCallback(dest, available, channels, bitsPerSample);
-        totalRxSamplesDelivered_ += read;
-        return static_cast<u32>(read * frameSize);
+    u32 rate = ReceiveFrameRate();
+    u64 available = std::min<u64>(FramesDue(receiveClock, rate), requestedSamples);
+    if (available > 0) {
+        if (audioInputCallback) {
+            available = audioInputCallback(dest, available, channels, bitsPerSample, rate);
+        } else {
+            memset(dest, 0, available * frameSize); // Fill with silence
+        }
+        receiveClock.delivered += available;
     }
-
-    // Fill with silence
-    totalRxSamplesDelivered_ += available;
+    ScheduleRequest(receiveClock, rate, std::min<u64>(requestedSamples, REQUEST_FRAMES));
     return static_cast<u32>(available * frameSize);
 }
 
@@ -153,29 +244,14 @@ u32 SPORT::DMAWrite(int x, int y, const void* source, u32 length)
     size_t requestedSamples = length / frameSize;
     if (requestedSamples == 0) return 0;
 
-    // Start timing on first DMA call after SPORT enable
-    if (!dmaTxActive_) {
-        dmaTxStartTime_ = std::chrono::steady_clock::now();
-        totalTxSamplesDelivered_ = 0;
-        dmaTxActive_ = true;
-    }
-
-    // How many samples are due based on elapsed time?
-    auto elapsed = std::chrono::steady_clock::now() - dmaTxStartTime_;
-    uint64_t elapsedNs = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
-    uint64_t totalDue = (elapsedNs * sampleRateHz_) / 1'000'000'000ULL;
-    // FIXME: too slow, / 10
-    totalDue = totalDue / 10;
-    uint64_t available = (totalDue > totalTxSamplesDelivered_)
-                         ? (totalDue - totalTxSamplesDelivered_) : 0;
-
-    if (available > requestedSamples) available = requestedSamples;
-    if (available == 0) return 0;  // Not time yet — DMA retries next cycle
-
-    if (audioOutputCallback) {
-        audioOutputCallback(source, available, channels, bitsPerSample);
+    u32 rate = TransmitFrameRate();
+    u64 available = std::min<u64>(FramesDue(transmitClock, rate), requestedSamples);
+    if (available > 0) {
+        if (audioOutputCallback) {
+            audioOutputCallback(source, available, channels, bitsPerSample, rate);
+        }
+        transmitClock.delivered += available;
     }
-
-    totalTxSamplesDelivered_ += available;
+    ScheduleRequest(transmitClock, rate, std::min<u64>(requestedSamples, REQUEST_FRAMES));
     return static_cast<u32>(available * frameSize);
 }
@@ -2,35 +2,65 @@
 
 #include "io.h"
 #include "dma.h"
+#include "utils/ring_buffer.h"
 #include <vector>
-#include <queue>
 #include <optional>
 #include <functional>
-#include <chrono>
 #include <cstdint>
 
 class SPORT : public RegisterDevice, public DMABus {
 public:
-    using AudioOutputCallback = std::function<void(const void* data, size_t samples, int channels, int bitsPerSample)>;
-    using AudioInputCallback = std::function<size_t(void* data, size_t samples, int channels, int bitsPerSample)>;
+    using AudioOutputCallback = std::function<void(const void* data, size_t samples, int channels, int bitsPerSample, u32 sampleRate)>;
+    using AudioInputCallback = std::function<size_t(void* data, size_t samples, int channels, int bitsPerSample, u32 sampleRate)>;
 
     SPORT(u32 baseAddr, int sportNum);
 
     // DMABus interface
     u32 DMARead(int x, int y, void* dest, u32 length) override;
     u32 DMAWrite(int x, int y, const void* source, u32 length) override;
+    bool DMARequest(bool memoryWrite) override;
+
+    // Called each instruction step with elapsed core clock cycles
+    void UpdateCycles(u64 cycles) { this->cycles = cycles; }
 
     // Audio callbacks
     void SetAudioOutputCallback(AudioOutputCallback callback) { audioOutputCallback = callback; }
     void SetAudioInputCallback(AudioInputCallback callback) { audioInputCallback = callback; }
 
+    // Frames moved by DMA against frames the sample clock made due, summed
+    // over every period the direction was enabled. A shortfall means the
+    // guest did not keep the DMA fed. CPU thread only.
+    struct FrameCounts {
+        u64 delivered = 0;
+        u64 expected = 0;
+    };
+    FrameCounts TransmitFrameCounts() const;
+    FrameCounts ReceiveFrameCounts() const;
+
 protected:
+    // Frame clock of one direction, in core clock cycles. Frames become due at
+    // `rate` per second from `startCycle`; the DMA request line is held low
+    // until `nextRequest` so the channel is not serviced in between.
+    struct SampleClock {
+        bool active = false;
+        u64 startCycle = 0;
+        u64 delivered = 0;   // frames transferred since startCycle
+        u64 nextRequest = 0; // cycle at which the next DMA request is raised
+    };
+
     void SetTransmitEnable();
     void SetReceiveEnable();
+    u32 TransmitFrameRate() const;
+    u32 ReceiveFrameRate() const;
+    u64 FramesDue(SampleClock& clock, u32 rate);
+    FrameCounts ClockFrameCounts(const SampleClock& clock, u32 rate) const;
+    void ScheduleRequest(SampleClock& clock, u32 rate, u64 frames);
 
     int sportNumber;
 
     bool transmitEnabled = false;
+    bool transmitInternalClock = false;
+    bool transmitInternalFrameSync = false;
     u8 transmitDataFormat = 0;
     bool transmitOrderLsbFirst = false;
     u8 transmitWordLength = 0;
@@ -41,6 +71,8 @@ protected:
     bool transmitUnderflow = false;
 
     bool receiveEnabled = false;
+    bool receiveInternalClock = false;
+    bool receiveInternalFrameSync = false;
     u8 receiveDataFormat = 0;
     bool receiveOrderLsbFirst = false;
     u8 receiveWordLength = 0;
@@ -50,26 +82,25 @@ protected:
     bool receiveOverflow = false;
     bool receiveUnderflow = false;
 
+    u16 transmitClockDivider = 0;     // TCLKDIV
+    u16 transmitFrameSyncDivider = 0; // TFSDIV
+    u16 receiveClockDivider = 0;      // RCLKDIV
+    u16 receiveFrameSyncDivider = 0;  // RFSDIV
+
     std::optional<u32> transmitHoldRegister;
     std::optional<u32> receiveHoldRegister;
-    // FIFO buffers
-    std::queue<u32> transmitFifo;
-    std::queue<u32> receiveFifo;
+    // FIFO buffers, 8x16-bit words or 4x32-bit words
+    RingBuffer<u32, 8> transmitFifo;
+    RingBuffer<u32, 8> receiveFifo;
 
     // Audio callbacks
     AudioOutputCallback audioOutputCallback;
     AudioInputCallback audioInputCallback;
 
-    // DMA timing state — TX path
-    std::chrono::steady_clock::time_point dmaTxStartTime_;
-    uint64_t totalTxSamplesDelivered_ = 0;
-    bool dmaTxActive_ = false;
-
-    // DMA timing state — RX path
-    std::chrono::steady_clock::time_point dmaRxStartTime_;
-    uint64_t totalRxSamplesDelivered_ = 0;
-    bool dmaRxActive_ = false;
-
-    // Nominal sample rate in Hz (future: derive from TCLKDIV/TFSDIV registers)
-    uint32_t sampleRateHz_ = 48000;
-};
+    // DMA timing state
+    u64 cycles = 0;
+    SampleClock transmitClock;
+    SampleClock receiveClock;
+    FrameCounts transmitTotals; // periods that have ended
+    FrameCounts receiveTotals;
+};
\ No newline at end of file
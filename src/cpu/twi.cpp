@@ -6,7 +6,7 @@ static constexpr u16 FIFO_EMPTY = 0x0;
 static constexpr u16 FIFO_HALF  = 0x1;
 static constexpr u16 FIFO_FULL  = 0x3;
 
-static constexpr size_t FIFO_SIZE = 2;
+static constexpr size_t FIFO_SIZE = 2; // capacity of xmtFifo/rcvFifo
 static constexpr int IVG_TWI = 10;
 
 TWI::TWI(u32 baseAddr) : RegisterDevice("TWI", baseAddr, 0x90) {
@@ -91,19 +91,15 @@ TWI::TWI(u32 baseAddr) : RegisterDevice("TWI", baseAddr, 0x90) {
 
     REG32(XMT_DATA8, 0x80);
     FIELD(XMT_DATA8, XMTDATA8, 0, 8, R(0), [this](u32 v) {
-        if (xmtFifo.size() < FIFO_SIZE) {
-            xmtFifo.push(v & 0xFF);
-        }
+        xmtFifo.push(v & 0xFF);
     });
 
     REG32(XMT_DATA16, 0x84);
     FIELD(XMT_DATA16, XMTDATA16, 0, 16, R(0), [this](u32 v) {
-        if (xmtFifo.size() < FIFO_SIZE) {
-            xmtFifo.push(v & 0xFF);
-            if (xmtFifo.size() < FIFO_SIZE) {
-                xmtFifo.push((v >> 8) & 0xFF);
-            }
-        }
+        u8 bytes[2];
+        bytes[0] = v & 0xFF;
+        bytes[1] = (v >> 8) & 0xFF;
+        xmtFifo.push_n(bytes, 2);
     });
 
     REG32(RCV_DATA8, 0x88);
@@ -116,16 +112,9 @@ TWI::TWI(u32 baseAddr) : RegisterDevice("TWI", baseAddr, 0x90) {
 
     REG32(RCV_DATA16, 0x8C);
     FIELD(RCV_DATA16, RCVDATA16, 0, 16, [this]() -> u32 {
-        u16 val = 0;
-        if (!rcvFifo.empty()) {
-            val = rcvFifo.front();
-            rcvFifo.pop();
-        }
-        if (!rcvFifo.empty()) {
-            val |= (rcvFifo.front() << 8);
-            rcvFifo.pop();
-        }
-        return val;
+        u8 bytes[2] = {};
+        rcvFifo.pop_n(bytes, 2);
+        return bytes[0] | (bytes[1] << 8);
     }, N());
 }
 
@@ -158,16 +147,14 @@ void TWI::ProcessMasterTransfer() {
             masterEnable = false;
         } else {
             auto client = iter->second;
-            std::vector<u8> data(bytesRead);
-            bool success = client->Read(data.data(), bytesRead);
+            u8 data[FIFO_SIZE];
+            bool success = client->Read(data, bytesRead);
             if (!success) {
                 masterBufferReadError = true;
                 masterTransferError = true;
             } else {
                 masterDCNT -= bytesRead;
-                for (size_t i = 0; i < bytesRead; i++) {
-                    rcvFifo.push(data[i]);
-                }
+                rcvFifo.push_n(data, bytesRead);
                 if (masterDCNT == 0) {
                     masterTransferComplete = true;
                 }
@@ -194,13 +181,10 @@ void TWI::ProcessMasterTransfer() {
             masterTransferError = true;
         } else {
             // Collect data from FIFO
-            std::vector<u8> data;
-            while (data.size() < bytesWrite) {
-                data.push_back(xmtFifo.front());
-                xmtFifo.pop();
-            }
+            u8 data[FIFO_SIZE];
+            xmtFifo.pop_n(data, bytesWrite);
             auto client = iter->second;
-            bool success = client->Write(data.data(), data.size());
+            bool success = client->Write(data, bytesWrite);
             if (!success) {
                 masterBufferWriteError = true;
                 masterTransferError = true;
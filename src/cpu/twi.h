@@ -1,7 +1,7 @@
 #pragma once
 
 #include "io.h"
-#include <queue>
+#include "utils/ring_buffer.h"
 #include <functional>
 #include <memory>
 #include <map>
@@ -106,8 +106,8 @@ protected:
     bool receiveBufferInterruptLength = false;
 
     // FIFO buffers
-    std::queue<u8> xmtFifo;
-    std::queue<u8> rcvFifo;
+    RingBuffer<u8, 2> xmtFifo;
+    RingBuffer<u8, 2> rcvFifo;
 
     std::map<u32, std::shared_ptr<I2CPeripheral>> clients;
 };
\ No newline at end of file
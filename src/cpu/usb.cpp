@@ -136,11 +136,11 @@ USB::USB(u32 baseAddr): RegisterDevice("USB", baseAddr, 0x500) {
     FIELD(USB_CSR0, FLUSHFIFO, 8, 1, R(0), [this](u32 v) {
         if (v) {
             if (endpoints[0].dataPacketReceived) {
-                endpoints[0].rxFifo = {};
+                endpoints[0].rxFifo.clear();
                 endpoints[0].dataPacketReceived = false;
             }
             if (endpoints[0].dataPacketInFIFO) {
-                endpoints[0].txFifo = {};
+                endpoints[0].txFifo.clear();
                 endpoints[0].dataPacketInFIFO = false;
             }
         }
@@ -189,7 +189,7 @@ USB::USB(u32 baseAddr): RegisterDevice("USB", baseAddr, 0x500) {
             auto flushfifo_w = [this, i](u32 v) {
                 if (v) {
                     if (endpoints[i].dataPacketReceived) {
-                        endpoints[i].rxFifo = {};
+                        endpoints[i].rxFifo.clear();
                         endpoints[i].dataPacketReceived = false;
                     }
                 }
@@ -276,13 +276,10 @@ u16 USB::ReadFifo(int ep) {
     auto& endpoint = endpoints[ep];
     u16 value = 0;
 
-    size_t available = endpoint.rxFifo.size();
-    if (available > 0) {
-        size_t toRead = std::min(available, sizeof(u16));
-        for (size_t i = 0; i < toRead; i++) {
-            value |= endpoint.rxFifo.front() << (i * 8);
-            endpoint.rxFifo.pop();
-        }
+    if (!endpoint.rxFifo.empty()) {
+        u8 bytes[sizeof(u16)] = {};
+        endpoint.rxFifo.pop_n(bytes, sizeof(u16));
+        value = bytes[0] | (bytes[1] << 8);
 
         if (endpoint.rxFifo.size() == 0 && endpoint.dataPacketReceivedAutoClear) {
             endpoint.dataPacketReceived = false;
@@ -300,10 +297,8 @@ void USB::WriteFifo(int ep, u16 value) {
     size_t maxSize = GetMaxFIFOSize(ep);
     size_t toWrite = std::min(sizeof(u16), std::min((std::size_t)endpoint.txCount, maxSize - currentSize));
 
-    for (size_t i = 0; i < toWrite; i++) {
-        u8 byte = value >> (i * 8);
-        endpoint.txFifo.push(byte);
-    }
+    u8 bytes[sizeof(u16)] = {(u8)value, (u8)(value >> 8)};
+    endpoint.txFifo.push_n(bytes, toWrite);
     endpoint.txCount -= toWrite;
 
     if (endpoint.txFifo.size() >= endpoint.txMaxPacketSize && endpoint.dataPacketInFIFOAutoSet) {
@@ -317,21 +312,11 @@ std::size_t USB::writeHostToDeviceFIFO(int ep, const u8* data, std::size_t lengt
     size_t maxSize = GetMaxFIFOSize(ep);
     size_t spaceAvailable = maxSize - currentSize;
     size_t toWrite = std::min(length, spaceAvailable);
-    for (size_t i = 0; i < toWrite; i++) {
-        endpoint.rxFifo.push(data[i]);
-    }
-    return toWrite;
+    return endpoint.rxFifo.push_n(data, toWrite);
 }
 
 std::size_t USB::readDeviceToHostFIFO(int ep, u8* data, std::size_t length) {
-    auto& endpoint = endpoints[ep];
-    size_t available = endpoint.txFifo.size();
-    size_t toRead = std::min(length, available);
-    for (size_t i = 0; i < toRead; i++) {
-        data[i] = endpoint.txFifo.front();
-        endpoint.txFifo.pop();
-    }
-    return toRead;
+    return endpoints[ep].txFifo.pop_n(data, length);
 }
 
 void USB::UpdateInterrupts() {
@@ -432,12 +417,10 @@ void USB::ProcessTransfer() {
         auto& ep = endpoints[i];
         // Process TX endpoints
         if ((epTxEnabled & (1 << i))) {
-            ep.txBuffer.reserve(ep.txFifo.size() + ep.txBuffer.size());
             if (ep.dataPacketInFIFO) {
-                while (!ep.txFifo.empty()) {
-                    ep.txBuffer.push_back(ep.txFifo.front());
-                    ep.txFifo.pop();
-                }
+                size_t buffered = ep.txBuffer.size();
+                ep.txBuffer.resize(buffered + ep.txFifo.size());
+                readDeviceToHostFIFO(i, ep.txBuffer.data() + buffered, ep.txFifo.size());
                 ep.dataPacketInFIFO = false;
                 epTxInterrupts |= (1 << i);
             }
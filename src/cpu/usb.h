@@ -1,11 +1,10 @@
 #pragma once
 
 #include "io.h"
+#include "utils/ring_buffer.h"
 #include <functional>
-#include <queue>
 #include <mutex>
 #include <vector>
-#include <queue>
 #include <memory>
 
 struct __attribute__ ((__packed__)) USBSetupBytes {
@@ -53,8 +52,9 @@ struct USBEndpoint {
     u8 rxType = 0;
     u8 rxInterval = 0;
 
-    std::queue<uint8_t> txFifo;
-    std::queue<uint8_t> rxFifo;
+    // Sized for the largest endpoint; GetMaxFIFOSize() limits the others
+    RingBuffer<uint8_t, 1024> txFifo;
+    RingBuffer<uint8_t, 1024> rxFifo;
 
     std::vector<uint8_t> txBuffer;
     std::size_t txLimit = 0;
@@ -5,16 +5,12 @@
 #include <algorithm>
 
 // MT29F4G08 specifications
-static constexpr u32 PAGE_SIZE = 2048;
-static constexpr u32 OOB_SIZE = 64;
-static constexpr u32 PAGE_TOTAL_SIZE = PAGE_SIZE + OOB_SIZE;
-static constexpr u32 PAGES_PER_BLOCK = 64;
-static constexpr u32 BLOCK_SIZE = PAGE_SIZE * PAGES_PER_BLOCK;
-static constexpr u32 TOTAL_BLOCKS = 4096;
-static constexpr u32 TOTAL_PAGES = TOTAL_BLOCKS * PAGES_PER_BLOCK;
-// Storage layout: all pages first, then all OOB areas
-static constexpr u64 OOB_AREA_OFFSET = static_cast<u64>(TOTAL_PAGES) * PAGE_SIZE;
-static constexpr u64 DEVICE_SIZE = OOB_AREA_OFFSET + (static_cast<u64>(TOTAL_PAGES) * OOB_SIZE); // ~ 4GB
+static constexpr u32 PAGE_SIZE = NandImage::PAGE_SIZE;
+static constexpr u32 PAGE_TOTAL_SIZE = NandImage::PAGE_TOTAL_SIZE;
+static constexpr u32 PAGES_PER_BLOCK = NandImage::PAGES_PER_BLOCK;
+static constexpr u32 TOTAL_BLOCKS = NandImage::TOTAL_BLOCKS;
+// Pages read ahead once reads are sequential, topped up when half are used
+static constexpr u32 PREFETCH_PAGES = 2 * PAGES_PER_BLOCK;
 
 static constexpr u8 COLUMN_CYCLES = 2;
 static constexpr u8 ROW_CYCLES = 3;
@@ -44,7 +40,7 @@ enum NandCommand : u8 {
     CMD_RESET = 0xFF,
 };
 
-static constexpr u8 ERASED_VALUE = 0xFF;
+static constexpr u8 ERASED_VALUE = NandImage::ERASED_VALUE;
 
 static constexpr u8 ID_DATA[] = {
     0x2C, // Manufacturer ID (Micron)
@@ -58,38 +54,23 @@ static constexpr u8 ID_ONFI[] = {
     0xFF,
 };
 
-MT29F4G08::MT29F4G08(BlackFinCpu& cpu, const std::string& storagePath)
+MT29F4G08::MT29F4G08(BlackFinCpu& cpu, const std::string& storagePath, const std::string& basePath)
     : cpu(cpu)
-    , storagePath(storagePath)
-    , pageBuffer(PAGE_TOTAL_SIZE, ERASED_VALUE)
+    , image(storagePath, basePath)
+    , erasedPage(PAGE_TOTAL_SIZE, ERASED_VALUE)
     , programBuffer(PAGE_TOTAL_SIZE, ERASED_VALUE)
     , statusRegister(NandStatus::Ready | NandStatus::WriteEnabled)
 {
-    // Try to open existing file, or create new one
-    storageFile.open(storagePath, std::ios::in | std::ios::out | std::ios::binary);
-    if (!storageFile.is_open()) {
-        // Create new file
-        storageFile.open(storagePath, std::ios::out | std::ios::binary);
-        if (storageFile.is_open()) {
-            // Initialize with erased state (0xFF)
-            std::vector<u8> eraseBuffer(PAGE_TOTAL_SIZE, ERASED_VALUE);
-            for (u32 page = 0; page < TOTAL_PAGES; ++page) {
-                storageFile.write(reinterpret_cast<char*>(eraseBuffer.data()), PAGE_TOTAL_SIZE);
-            }
-            storageFile.close();
-            storageFile.open(storagePath, std::ios::in | std::ios::out | std::ios::binary);
-        }
-    }
+    pageData = erasedPage.data();
+    pageOob = erasedPage.data() + PAGE_SIZE;
+}
 
-    if (!storageFile.is_open()) {
-        LogError("MT29F4G08: Failed to open storage file: %s", storagePath.c_str());
-    }
+void MT29F4G08::SetDurability(NandDurability policy, std::chrono::milliseconds interval) {
+    image.SetDurability(policy, interval);
 }
 
-MT29F4G08::~MT29F4G08() {
-    if (storageFile.is_open()) {
-        storageFile.close();
-    }
+void MT29F4G08::Flush() {
+    image.Flush();
 }
 
 void MT29F4G08::SendCommand(u8 command) {
@@ -199,7 +180,9 @@ u8 MT29F4G08::ReadData() {
         return ERASED_VALUE;
     }
     if (dataOffset < PAGE_TOTAL_SIZE) {
-        return pageBuffer[dataOffset++];
+        u8 value;
+        CopyFromPage(&value, dataOffset++, 1);
+        return value;
     }
     return ERASED_VALUE;
 }
@@ -223,8 +206,8 @@ u32 MT29F4G08::PageWrite(const u8* data, u32 length) {
 }
 
 u32 MT29F4G08::PageRead(u8* data, u32 length) {
-    u32 readLen = std::min(length, PAGE_TOTAL_SIZE - dataOffset);
-    std::memcpy(data, pageBuffer.data() + dataOffset, readLen);
+    u32 readLen = dataOffset < PAGE_TOTAL_SIZE ? std::min(length, PAGE_TOTAL_SIZE - dataOffset) : 0;
+    CopyFromPage(data, dataOffset, readLen);
     dataOffset += readLen;
     return readLen;
 }
@@ -264,65 +247,36 @@ u32 MT29F4G08::GetBlockAddress() const {
     return pageNumber / PAGES_PER_BLOCK;
 }
 
+// Points the page register at the page in the image mapping. Reads see
+// later programs and erases of the same page; the firmware always issues a
+// new READ after modifying a page, so this is never observable.
 void MT29F4G08::LoadPage(u32 pageNumber) {
-    if (pageNumber >= TOTAL_PAGES) {
-        std::fill(pageBuffer.begin(), pageBuffer.end(), ERASED_VALUE);
-        return;
+    image.Page(pageNumber, pageData, pageOob);
+    if (!pageData) {
+        pageData = erasedPage.data();
+        pageOob = erasedPage.data() + PAGE_SIZE;
     }
+}
 
-    if (!storageFile.is_open()) {
-        std::fill(pageBuffer.begin(), pageBuffer.end(), ERASED_VALUE);
-        return;
+// Copies `length` bytes of the page register from `offset`, where the OOB
+// area follows the data area
+void MT29F4G08::CopyFromPage(u8* dest, u32 offset, u32 length) const {
+    if (offset < PAGE_SIZE) {
+        u32 n = std::min(length, PAGE_SIZE - offset);
+        std::memcpy(dest, pageData + offset, n);
+        dest += n;
+        offset += n;
+        length -= n;
     }
-
-    // Read page data
-    u64 pageOffset = static_cast<u64>(pageNumber) * PAGE_SIZE;
-    storageFile.seekg(pageOffset, std::ios::beg);
-    storageFile.read(reinterpret_cast<char*>(pageBuffer.data()), PAGE_SIZE);
-
-    // Read OOB data
-    u64 oobOffset = OOB_AREA_OFFSET + (static_cast<u64>(pageNumber) * OOB_SIZE);
-    storageFile.seekg(oobOffset, std::ios::beg);
-    storageFile.read(reinterpret_cast<char*>(pageBuffer.data() + PAGE_SIZE), OOB_SIZE);
-
-    if (!storageFile) {
-        std::fill(pageBuffer.begin(), pageBuffer.end(), ERASED_VALUE);
-        storageFile.clear();
+    if (length) {
+        std::memcpy(dest, pageOob + (offset - PAGE_SIZE), length);
     }
 }
 
 void MT29F4G08::SavePage(u32 pageNumber) {
-    if (pageNumber >= TOTAL_PAGES) {
-        return;
-    }
-
-    if (!storageFile.is_open()) {
-        return;
-    }
-
-    // Load current page data
+    // Program operation: AND with the program buffer, bits can only be cleared
+    image.Program(pageNumber, programBuffer.data());
     LoadPage(pageNumber);
-
-    // Apply program operation (AND with program buffer - can only clear bits)
-    for (u32 i = 0; i < PAGE_TOTAL_SIZE; ++i) {
-        pageBuffer[i] &= programBuffer[i];
-    }
-
-    // Write page data
-    u64 pageOffset = static_cast<u64>(pageNumber) * PAGE_SIZE;
-    storageFile.seekp(pageOffset, std::ios::beg);
-    storageFile.write(reinterpret_cast<char*>(pageBuffer.data()), PAGE_SIZE);
-
-    // Write OOB data
-    u64 oobOffset = OOB_AREA_OFFSET + (static_cast<u64>(pageNumber) * OOB_SIZE);
-    storageFile.seekp(oobOffset, std::ios::beg);
-    storageFile.write(reinterpret_cast<char*>(pageBuffer.data() + PAGE_SIZE), OOB_SIZE);
-
-    storageFile.flush();
-
-    if (!storageFile) {
-        storageFile.clear();
-    }
 }
 
 void MT29F4G08::ExecuteRead() {
@@ -332,12 +286,30 @@ void MT29F4G08::ExecuteRead() {
 
     LoadPage(pageNumber);
     dataOffset = column;
+    ReadAhead(pageNumber);
 
     if (readCallback) {
         readCallback(*this);
     }
 }
 
+// Boot and sample loading read pages in order; keep the pages after a run
+// of sequential reads queued for the image's read-ahead thread
+void MT29F4G08::ReadAhead(u32 pageNumber) {
+    bool sequential = pageNumber == lastReadPage + 1;
+    lastReadPage = pageNumber;
+    if (!sequential) {
+        prefetchEnd = 0;
+        return;
+    }
+    if (pageNumber + PREFETCH_PAGES / 2 < prefetchEnd) {
+        return;
+    }
+    u32 first = std::max(pageNumber + 1, prefetchEnd);
+    prefetchEnd = pageNumber + 1 + PREFETCH_PAGES;
+    image.Prefetch(first, prefetchEnd - first);
+}
+
 void MT29F4G08::ExecuteProgram() {
     SetBusy();
     u32 pageNumber = GetCurrentPage();
@@ -352,31 +324,5 @@ void MT29F4G08::ExecuteErase() {
         return;
     }
 
-    if (!storageFile.is_open()) {
-        return;
-    }
-
-    // Erase all pages in the block
-    std::vector<u8> erasedPage(PAGE_SIZE, ERASED_VALUE);
-    std::vector<u8> erasedOob(OOB_SIZE, ERASED_VALUE);
-    u32 startPage = blockNumber * PAGES_PER_BLOCK;
-
-    for (u32 i = 0; i < PAGES_PER_BLOCK; ++i) {
-        u32 pageNumber = startPage + i;
-
-        // Erase page data
-        u64 pageOffset = static_cast<u64>(pageNumber) * PAGE_SIZE;
-        storageFile.seekp(pageOffset, std::ios::beg);
-        storageFile.write(reinterpret_cast<char*>(erasedPage.data()), PAGE_SIZE);
-
-        // Erase OOB data
-        u64 oobOffset = OOB_AREA_OFFSET + (static_cast<u64>(pageNumber) * OOB_SIZE);
-        storageFile.seekp(oobOffset, std::ios::beg);
-        storageFile.write(reinterpret_cast<char*>(erasedOob.data()), OOB_SIZE);
-    }
-    storageFile.flush();
-
-    if (!storageFile) {
-        storageFile.clear();
-    }
+    image.Erase(blockNumber);
 }
\ No newline at end of file
@@ -1,15 +1,20 @@
 #pragma once
 
 #include "cpu/nand.h"
+#include "nand_image.h"
 #include <vector>
-#include <fstream>
 
 class BlackFinCpu;
 
+// Page reads are served straight from the image mapping and programs and
+// erases modify it in place (see NandImage), so nothing on the CPU thread
+// waits for the disk unless the durability policy is Synchronous. Runs of
+// sequential page reads have the following pages read ahead.
 class MT29F4G08 : public NandFlash {
 public:
-    MT29F4G08(BlackFinCpu& cpu, const std::string& storagePath);
-    ~MT29F4G08();
+    // With a `basePath`, `storagePath` is a delta file over that read-only
+    // image, which several instances can share
+    MT29F4G08(BlackFinCpu& cpu, const std::string& storagePath, const std::string& basePath = "");
 
     void SendCommand(u8 command) override;
     void SendAddress(u8 address) override;
@@ -23,6 +28,11 @@ public:
     bool IsDataReady() const override;
     bool IsBusy() const override;
 
+    void SetDurability(NandDurability policy, std::chrono::milliseconds interval = std::chrono::seconds(1));
+    // Writes every modified block back to the storage file and waits for
+    // it, e.g. on shutdown or before copying the image. Safe from any thread.
+    void Flush();
+
 protected:
     ReadCallback readCallback;
 
@@ -33,15 +43,20 @@ protected:
     void ExecuteErase();
     u8 HandleReadID();
     void LoadPage(u32 pageNumber);
+    void ReadAhead(u32 pageNumber);
     void SavePage(u32 pageNumber);
+    void CopyFromPage(u8* dest, u32 offset, u32 length) const;
     u32 GetCurrentPage() const;
     u32 GetColumnAddress() const;
     u32 GetBlockAddress() const;
 
     BlackFinCpu& cpu;
-    std::string storagePath;
-    std::fstream storageFile;
-    std::vector<u8> pageBuffer;
+    NandImage image;
+    // Page register: the loaded page's data and OOB areas, inside the
+    // image mapping or `erasedPage`
+    const u8* pageData = nullptr;
+    const u8* pageOob = nullptr;
+    std::vector<u8> erasedPage;
     std::vector<u8> programBuffer;
 
     u8 currentCommand = 0;
@@ -54,5 +69,9 @@ protected:
     u32 dataOffset = 0;
     u32 idOffset = 0;
 
+    // Read-ahead: pages from the last READ up to prefetchEnd are queued
+    u32 lastReadPage = ~0u;
+    u32 prefetchEnd = 0;
+
     bool isBusy = false;
 };
\ No newline at end of file
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+class AudioInput {
+public:
+    virtual ~AudioInput() = default;
+
+    // Called from CPU thread (via SPORT DMA callback); must not block.
+    // data: destination for raw PCM samples in the SPORT's word format
+    // samples: number of sample frames requested
+    // channels: 1 (mono) or 2 (stereo)
+    // bitsPerSample: typically 16 or 24
+    // sampleRate: frame rate the SPORT is configured for, which the input
+    // resamples to
+    // Returns the number of frames written. Implementations fill missing
+    // input with silence so the guest's sample clock keeps running.
+    virtual size_t ReadSamples(void* data, size_t samples, int channels, int bitsPerSample, uint32_t sampleRate) = 0;
+};
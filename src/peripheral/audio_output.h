@@ -1,8 +1,21 @@
 #pragma once
 
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 
+// Audio output health counters. Totals since the output was created, except
+// queuedFrames which is the current fill.
+struct AudioTelemetry {
+    uint64_t framesWritten = 0;  // frames accepted from the SPORT
+    uint64_t framesDropped = 0;  // frames discarded because the queue was full
+    uint64_t underrunFrames = 0; // silence played because the queue ran dry
+    uint64_t queuedFrames = 0;   // frames written but not yet played
+    uint64_t callbacks = 0;      // device callbacks
+    uint64_t callbackJitterMicros = 0;    // mean deviation from the nominal callback period
+    uint64_t maxCallbackJitterMicros = 0; // largest deviation seen
+};
+
 class AudioOutput {
 public:
     virtual ~AudioOutput() = default;
@@ -12,5 +25,21 @@ public:
     // samples: number of sample frames
     // channels: 1 (mono) or 2 (stereo)
     // bitsPerSample: typically 16 or 24
-    virtual void WriteSamples(const void* data, size_t samples, int channels, int bitsPerSample) = 0;
+    // sampleRate: frame rate the SPORT is configured for
+    virtual void WriteSamples(const void* data, size_t samples, int channels, int bitsPerSample, uint32_t sampleRate) = 0;
+
+    // Audio clock for PacingMode::Audio. Frames written but not yet played,
+    // and the queue depth the CPU thread should hold. Outputs that are not
+    // played in real time keep the default of no queue.
+    virtual size_t QueuedFrames() const { return 0; }
+    virtual size_t TargetQueuedFrames() const { return 0; }
+    // Blocks until fewer than `frames` frames are queued or `deadline`
+    // passes, woken as the output plays.
+    virtual void WaitQueuedBelow(size_t frames, std::chrono::steady_clock::time_point deadline) {}
+    // While the CPU thread holds the queue at its target, the output must
+    // not steer the fill itself and plays at the nominal rate.
+    virtual void SetQueuePaced(bool paced) {}
+
+    // Safe to call from any thread.
+    virtual AudioTelemetry Telemetry() const { return {}; }
 };
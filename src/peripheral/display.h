@@ -8,5 +8,14 @@ public:
 
     virtual void Initialize(int rows, int lines) = 0;
     virtual void UpdateRowBuffer(int x, int y, const void* data, int length) = 0;
+    // Called after the last row of a frame has been written
+    virtual void FrameComplete() {}
+    // Zero-copy scanout, in place of UpdateRowBuffer() and FrameComplete()
+    // for a whole frame: `pixels` points at the first row in guest RAM and
+    // rows are `stride` bytes apart. The pointer stays valid for the life of
+    // the emulator, but the guest keeps writing to it, so the display reads
+    // the pixels whenever it presents. Returns false to receive the frame
+    // row by row instead.
+    virtual bool ScanoutFrame(const void* pixels, int stride) { return false; }
     virtual void SetOnFrameStartCallback(const std::function<void(Display&)>& callback) = 0;
 };
\ No newline at end of file
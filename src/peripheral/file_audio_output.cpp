@@ -0,0 +1,140 @@
+#include "file_audio_output.h"
+#include "utils/log.h"
+#include "utils/wav.h"
+#include <algorithm>
+#include <cstring>
+
+// WAV header rate until the first samples give the stream's own
+static constexpr uint32_t DEFAULT_SAMPLE_RATE = 48000;
+// The writer wakes up once this much (at most half the ring) is buffered, or
+// every FLUSH_INTERVAL
+static constexpr size_t WRITE_CHUNK_BYTES = 64 << 10;
+static constexpr auto FLUSH_INTERVAL = std::chrono::milliseconds(100);
+
+FileAudioOutput::FileAudioOutput(const std::string& path, Format format, size_t bufferBytes)
+    // A capacity in whole 32-bit words keeps every frame contiguous in the ring
+    : format(format), ring(std::max<size_t>(bufferBytes, 4096) & ~(size_t)3)
+    , chunkBytes(std::min(WRITE_CHUNK_BYTES, ring.size() / 2)) {
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        LogError("Failed to open audio output file: %s", path.c_str());
+        running = false;
+        return;
+    }
+    if (format == Format::Wav) {
+        WriteWavHeader(file, 2, DEFAULT_SAMPLE_RATE, 16, 0); // rewritten on close
+    }
+    thread = std::thread([this]() { WriterThread(); });
+    LogInfo("Audio output to %s (%s)", path.c_str(), format == Format::Wav ? "wav" : "raw");
+}
+
+FileAudioOutput::~FileAudioOutput() {
+    if (!file.is_open()) {
+        return;
+    }
+    {
+        // Under the mutex, so that the writer cannot miss the wakeup
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wakeup.notify_all();
+    thread.join();
+    Drain();
+
+    if (format == Format::Wav) {
+        int wavBits = bitsPerSample > 16 ? 24 : 16;
+        file.seekp(0);
+        WriteWavHeader(file, channels ? channels : 2, sampleRate ? sampleRate : DEFAULT_SAMPLE_RATE, wavBits,
+                       (uint32_t)dataBytes);
+    }
+    LogInfo("Audio output closed: %llu frames written, %llu dropped",
+            (unsigned long long)framesWritten.load(), (unsigned long long)framesDropped.load());
+}
+
+void FileAudioOutput::WriteSamples(const void* data, size_t samples, int channels, int bitsPerSample,
+                                   uint32_t sampleRate) {
+    if (!file.is_open() || samples == 0) {
+        return;
+    }
+    if (this->channels == 0) {
+        // Published to the writer thread by the release store of `tail`
+        this->channels = channels;
+        this->bitsPerSample = bitsPerSample;
+        this->sampleRate = sampleRate;
+    } else if (channels != this->channels || (bitsPerSample > 16) != (this->bitsPerSample > 16) ||
+               sampleRate != this->sampleRate) {
+        framesDropped.fetch_add(samples, std::memory_order_relaxed);
+        return;
+    }
+
+    size_t frameBytes = FrameBytes();
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t used = t - head.load(std::memory_order_acquire);
+    size_t frames = std::min(samples, (ring.size() - used) / frameBytes);
+    if (frames < samples) {
+        framesDropped.fetch_add(samples - frames, std::memory_order_relaxed);
+    }
+
+    size_t bytes = frames * frameBytes;
+    size_t offset = t % ring.size();
+    size_t first = std::min(bytes, ring.size() - offset);
+    const uint8_t* src = static_cast<const uint8_t*>(data);
+    memcpy(ring.data() + offset, src, first);
+    memcpy(ring.data(), src + first, bytes - first);
+    tail.store(t + bytes, std::memory_order_release);
+    framesWritten.fetch_add(frames, std::memory_order_relaxed);
+
+    if (used < chunkBytes && used + bytes >= chunkBytes) {
+        wakeup.notify_one();
+    }
+}
+
+AudioTelemetry FileAudioOutput::Telemetry() const {
+    AudioTelemetry telemetry;
+    telemetry.framesWritten = framesWritten.load(std::memory_order_relaxed);
+    telemetry.framesDropped = framesDropped.load(std::memory_order_relaxed);
+    // A nonzero `tail` also publishes the stream format
+    size_t t = tail.load(std::memory_order_acquire);
+    if (t) {
+        telemetry.queuedFrames = (t - head.load(std::memory_order_acquire)) / FrameBytes();
+    }
+    return telemetry;
+}
+
+void FileAudioOutput::WriterThread() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running) {
+        wakeup.wait_for(lock, FLUSH_INTERVAL, [this]() {
+            return !running || tail.load() - head.load() >= chunkBytes;
+        });
+        Drain();
+    }
+}
+
+// Writes out everything buffered so far, in at most two contiguous pieces.
+void FileAudioOutput::Drain() {
+    size_t h = head.load(std::memory_order_relaxed);
+    size_t t = tail.load(std::memory_order_acquire);
+    while (h != t) {
+        size_t offset = h % ring.size();
+        size_t bytes = std::min(t - h, ring.size() - offset);
+        const uint8_t* data = ring.data() + offset;
+
+        if (format == Format::Wav && bitsPerSample > 16) {
+            // Pack 24-in-32 words into 3-byte samples
+            size_t words = bytes / 4;
+            scratch.resize(words * 3);
+            for (size_t i = 0; i < words; i++) {
+                memcpy(scratch.data() + i * 3, data + i * 4, 3);
+            }
+            file.write(reinterpret_cast<const char*>(scratch.data()), scratch.size());
+            dataBytes += scratch.size();
+        } else {
+            file.write(reinterpret_cast<const char*>(data), bytes);
+            dataBytes += bytes;
+        }
+        h += bytes;
+        head.store(h, std::memory_order_release);
+    }
+    file.flush();
+}
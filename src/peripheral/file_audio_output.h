@@ -0,0 +1,83 @@
+#pragma once
+
+#include "audio_output.h"
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Audio sink that needs no sound device, for headless runs and golden-file
+// captures. WriteSamples only copies into a preallocated single-producer/
+// single-consumer ring; a background thread writes it out in large chunks.
+// The stream format, including the sample rate, is fixed by the first
+// WriteSamples call.
+class FileAudioOutput : public AudioOutput {
+public:
+    enum class Format {
+        Wav, // 16-bit, or 24-bit packed for 24-in-32 input
+        Raw, // SPORT words as delivered (16-bit, or 24-in-32 little endian)
+    };
+
+    FileAudioOutput(const std::string& path, Format format, size_t bufferBytes = 4 << 20);
+    ~FileAudioOutput() override;
+
+    bool IsOpen() const { return file.is_open(); }
+    void WriteSamples(const void* data, size_t samples, int channels, int bitsPerSample, uint32_t sampleRate) override;
+
+    uint64_t FramesWritten() const { return framesWritten.load(); }
+    uint64_t FramesDropped() const { return framesDropped.load(); }
+    AudioTelemetry Telemetry() const override;
+
+private:
+    void WriterThread();
+    void Drain();
+    size_t FrameBytes() const { return (bitsPerSample > 16 ? 4 : 2) * channels; }
+
+    std::ofstream file;
+    Format format;
+    uint64_t dataBytes = 0; // bytes written after the WAV header
+
+    // Ring positions count bytes since the start and only ever grow; `head`
+    // is advanced by the writer thread, `tail` by WriteSamples.
+    std::vector<uint8_t> ring;
+    size_t chunkBytes; // fill that wakes the writer thread
+    std::atomic<size_t> head{0};
+    std::atomic<size_t> tail{0};
+    std::vector<uint8_t> scratch; // WAV repacking, writer thread only
+
+    int channels = 0;
+    int bitsPerSample = 0;
+    uint32_t sampleRate = 0;
+    std::atomic<uint64_t> framesWritten{0};
+    std::atomic<uint64_t> framesDropped{0};
+
+    std::atomic<bool> running{true};
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+};
+
+// Discards samples and only counts them, to measure the audio path without
+// any output cost.
+class NullAudioOutput : public AudioOutput {
+public:
+    void WriteSamples(const void* data, size_t samples, int channels, int bitsPerSample, uint32_t sampleRate) override {
+        frames.fetch_add(samples, std::memory_order_relaxed);
+        calls.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t Frames() const { return frames.load(); }
+    uint64_t Calls() const { return calls.load(); }
+    AudioTelemetry Telemetry() const override {
+        AudioTelemetry telemetry;
+        telemetry.framesWritten = frames.load(std::memory_order_relaxed);
+        return telemetry;
+    }
+
+private:
+    std::atomic<uint64_t> frames{0};
+    std::atomic<uint64_t> calls{0};
+};
@@ -0,0 +1,218 @@
+#include "headless_display.h"
+#include "utils/hash.h"
+#include "utils/log.h"
+#include <cstring>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+// Frames waiting for the writer beyond this are dropped
+static constexpr size_t MAX_QUEUED_FRAMES = 8;
+static constexpr int Y4M_FRAME_RATE = 60;
+
+HeadlessDisplay::HeadlessDisplay() {
+    thread = std::thread([this]() { WriterThread(); });
+}
+
+HeadlessDisplay::~HeadlessDisplay() {
+    StopDump();
+    {
+        // Under the mutex, so that the writer cannot miss the wakeup
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wakeup.notify_all();
+    thread.join();
+}
+
+void HeadlessDisplay::Initialize(int rows, int lines) {
+    if (rows == width && lines == height) {
+        return;
+    }
+    width = rows;
+    height = lines;
+    framebuffer.assign(width * height, 0);
+}
+
+void HeadlessDisplay::UpdateRowBuffer(int x, int y, const void* data, int length) {
+    if (y < 0 || y >= height || x < 0) return;
+
+    int pixelsToCopy = length / sizeof(uint16_t);
+    if (x + pixelsToCopy > width) {
+        pixelsToCopy = width - x;
+    }
+    if (pixelsToCopy > 0) {
+        std::memcpy(&framebuffer[y * width + x], data, pixelsToCopy * sizeof(uint16_t));
+    }
+}
+
+void HeadlessDisplay::FrameComplete() {
+    frameHash.store(Hash64(framebuffer.data(), framebuffer.size() * sizeof(uint16_t)));
+    frameCount.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(frameMutex);
+        lastFrame = framebuffer;
+        lastWidth = width;
+        lastHeight = height;
+    }
+    if (dumping.load()) {
+        DumpJob job{DumpJob::Frame};
+        job.pixels = framebuffer;
+        job.width = width;
+        job.height = height;
+        QueueJob(std::move(job));
+    }
+}
+
+void HeadlessDisplay::StartFrame() {
+    if (onFrameStartCallback) {
+        onFrameStartCallback(*this);
+    }
+}
+
+std::vector<uint16_t> HeadlessDisplay::LastFrame(int* frameWidth, int* frameHeight) {
+    std::lock_guard<std::mutex> lock(frameMutex);
+    if (frameWidth) *frameWidth = lastWidth;
+    if (frameHeight) *frameHeight = lastHeight;
+    return lastFrame;
+}
+
+void HeadlessDisplay::StartDump(const std::string& path, DumpFormat format) {
+    DumpJob job{DumpJob::Open};
+    job.path = path;
+    job.format = format;
+    QueueJob(std::move(job));
+    dumping = true;
+}
+
+void HeadlessDisplay::StopDump() {
+    if (dumping.exchange(false)) {
+        QueueJob(DumpJob{DumpJob::Close});
+    }
+}
+
+void HeadlessDisplay::SaveFrame(const std::string& path) {
+    DumpJob job{DumpJob::Snapshot};
+    job.pixels = LastFrame(&job.width, &job.height);
+    job.path = path;
+    QueueJob(std::move(job));
+}
+
+void HeadlessDisplay::QueueJob(DumpJob job) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (job.type == DumpJob::Frame && jobs.size() >= MAX_QUEUED_FRAMES) {
+            droppedDumpFrames.fetch_add(1);
+            return;
+        }
+        jobs.push_back(std::move(job));
+    }
+    wakeup.notify_one();
+}
+
+// Runs jobs until stopped, then finishes whatever is still queued.
+void HeadlessDisplay::WriterThread() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wakeup.wait(lock, [this]() { return !running || !jobs.empty(); });
+        if (jobs.empty()) {
+            break;
+        }
+        DumpJob job = std::move(jobs.front());
+        jobs.pop_front();
+        lock.unlock();
+        WriteJob(job);
+        lock.lock();
+    }
+}
+
+void HeadlessDisplay::WriteJob(DumpJob& job) {
+    switch (job.type) {
+    case DumpJob::Open:
+        dumpFile.close();
+        dumpFormat = job.format;
+        dumpPath = job.path;
+        dumpedFrames = 0;
+        if (dumpFormat != DumpFormat::Png) {
+            dumpFile.open(dumpPath, std::ios::binary | std::ios::trunc);
+            if (!dumpFile.is_open()) {
+                LogError("Failed to open frame dump file: %s", dumpPath.c_str());
+                return;
+            }
+        }
+        LogInfo("Dumping display frames to %s", dumpPath.c_str());
+        break;
+    case DumpJob::Close:
+        dumpFile.close();
+        LogInfo("Frame dump closed: %llu frames, %llu dropped", (unsigned long long)dumpedFrames,
+                (unsigned long long)droppedDumpFrames.load());
+        break;
+    case DumpJob::Snapshot:
+        WritePng(job.path, job);
+        break;
+    case DumpJob::Frame:
+        if (dumpFormat == DumpFormat::Png) {
+            char suffix[32];
+            snprintf(suffix, sizeof(suffix), "%06llu.png", (unsigned long long)dumpedFrames);
+            WritePng(dumpPath + suffix, job);
+        } else if (!dumpFile.is_open()) {
+            return;
+        } else if (dumpFormat == DumpFormat::Y4m) {
+            WriteY4m(job);
+        } else {
+            dumpFile.write(reinterpret_cast<const char*>(job.pixels.data()), job.pixels.size() * sizeof(uint16_t));
+        }
+        dumpedFrames++;
+        break;
+    }
+}
+
+static inline void RGB565ToRGB(uint16_t pixel, int& r, int& g, int& b)
+{
+    r = (pixel >> 11) & 0x1F;
+    g = (pixel >> 5) & 0x3F;
+    b = pixel & 0x1F;
+    r = (r << 3) | (r >> 2);
+    g = (g << 2) | (g >> 4);
+    b = (b << 3) | (b >> 2);
+}
+
+void HeadlessDisplay::WritePng(const std::string& path, const DumpJob& job) {
+    if (job.pixels.empty()) {
+        return;
+    }
+    scratch.resize(job.pixels.size() * 3);
+    for (size_t i = 0; i < job.pixels.size(); i++) {
+        int r, g, b;
+        RGB565ToRGB(job.pixels[i], r, g, b);
+        scratch[i * 3] = r;
+        scratch[i * 3 + 1] = g;
+        scratch[i * 3 + 2] = b;
+    }
+    if (!stbi_write_png(path.c_str(), job.width, job.height, 3, scratch.data(), job.width * 3)) {
+        LogError("Failed to write PNG: %s", path.c_str());
+    }
+}
+
+// One 4:4:4 frame, BT.601 limited range. The stream header is written with
+// the first frame since the size is only known then.
+void HeadlessDisplay::WriteY4m(const DumpJob& job) {
+    if (dumpedFrames == 0) {
+        dumpFile << "YUV4MPEG2 W" << job.width << " H" << job.height << " F" << Y4M_FRAME_RATE
+                 << ":1 Ip A1:1 C444\n";
+    }
+    size_t count = job.pixels.size();
+    scratch.resize(count * 3);
+    uint8_t* yPlane = scratch.data();
+    uint8_t* uPlane = yPlane + count;
+    uint8_t* vPlane = uPlane + count;
+    for (size_t i = 0; i < count; i++) {
+        int r, g, b;
+        RGB565ToRGB(job.pixels[i], r, g, b);
+        yPlane[i] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+        uPlane[i] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+        vPlane[i] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+    }
+    dumpFile << "FRAME\n";
+    dumpFile.write(reinterpret_cast<const char*>(scratch.data()), scratch.size());
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "display.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Display without a window, for regression and performance runs on servers.
+// Frames stay in memory as RGB565; every completed frame is hashed on the
+// CPU thread, and can optionally be dumped to disk. Encoding and file I/O
+// run on a background thread fed by a short queue, so a slow disk drops
+// dumped frames instead of stalling emulation.
+class HeadlessDisplay : public Display {
+public:
+    enum class DumpFormat {
+        Png, // one PNG per frame, <path>NNNNNN.png
+        Raw, // RGB565 frames back to back
+        Y4m, // YUV4MPEG2 4:4:4 stream, playable with ffmpeg/mpv
+    };
+
+    HeadlessDisplay();
+    ~HeadlessDisplay() override;
+
+    // Display interface
+    void Initialize(int rows, int lines) override;
+    void UpdateRowBuffer(int x, int y, const void* data, int length) override;
+    void FrameComplete() override;
+    void SetOnFrameStartCallback(const std::function<void(Display&)>& callback) override {
+        onFrameStartCallback = callback;
+    }
+
+    // Raises the frame start signal, as the GUI does once per refresh
+    void StartFrame();
+
+    // Dumps every following frame until StopDump(). Frames are written in
+    // order; failures are logged by the writer thread.
+    void StartDump(const std::string& path, DumpFormat format);
+    void StopDump();
+    // Writes the latest completed frame as a PNG
+    void SaveFrame(const std::string& path);
+
+    // Safe to call from any thread
+    uint64_t FrameCount() const { return frameCount.load(); }
+    uint64_t FrameHash() const { return frameHash.load(); }
+    uint64_t DroppedDumpFrames() const { return droppedDumpFrames.load(); }
+    // Copy of the latest completed frame and its size
+    std::vector<uint16_t> LastFrame(int* frameWidth = nullptr, int* frameHeight = nullptr);
+
+private:
+    // Work for the writer thread, executed in queue order. Only Frame jobs
+    // are dropped when the queue is full.
+    struct DumpJob {
+        enum { Open, Close, Frame, Snapshot } type;
+        std::vector<uint16_t> pixels;
+        int width = 0;
+        int height = 0;
+        std::string path;                      // Open, Snapshot
+        DumpFormat format = DumpFormat::Raw;   // Open
+    };
+
+    void QueueJob(DumpJob job);
+    void WriterThread();
+    void WriteJob(DumpJob& job);
+    void WritePng(const std::string& path, const DumpJob& job);
+    void WriteY4m(const DumpJob& job);
+
+    int width = 0;  // CPU thread
+    int height = 0; // CPU thread
+    std::vector<uint16_t> framebuffer; // CPU thread
+    std::function<void(Display&)> onFrameStartCallback;
+
+    std::atomic<uint64_t> frameCount{0};
+    std::atomic<uint64_t> frameHash{0};
+    std::atomic<uint64_t> droppedDumpFrames{0};
+    std::mutex frameMutex;
+    std::vector<uint16_t> lastFrame; // guarded by frameMutex
+    int lastWidth = 0;
+    int lastHeight = 0;
+
+    std::atomic<bool> dumping{false}; // frames are being queued for the writer
+
+    // Dump output, writer thread only
+    DumpFormat dumpFormat = DumpFormat::Raw;
+    std::string dumpPath;
+    std::ofstream dumpFile;
+    uint64_t dumpedFrames = 0;
+    std::vector<uint8_t> scratch;
+
+    std::deque<DumpJob> jobs;
+    std::atomic<bool> running{true};
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+};
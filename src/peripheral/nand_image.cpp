@@ -0,0 +1,627 @@
+#include "nand_image.h"
+#include "utils/log.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef MADV_POPULATE_READ
+#define MADV_POPULATE_READ 22 // Linux 5.14
+#endif
+
+static constexpr u32 BLOCK_SIZE = NandImage::PAGE_SIZE * NandImage::PAGES_PER_BLOCK;
+static constexpr u32 BLOCK_OOB_SIZE = NandImage::OOB_SIZE * NandImage::PAGES_PER_BLOCK;
+static constexpr u32 BLOCK_TOTAL_SIZE = NandImage::PAGE_TOTAL_SIZE * NandImage::PAGES_PER_BLOCK;
+// Split layout: all pages first, then all OOB areas
+static constexpr u64 OOB_AREA_OFFSET = static_cast<u64>(NandImage::TOTAL_PAGES) * NandImage::PAGE_SIZE;
+static constexpr u64 DEVICE_SIZE = OOB_AREA_OFFSET + static_cast<u64>(NandImage::TOTAL_PAGES) * NandImage::OOB_SIZE;
+
+static constexpr u32 ERASED_BITMAP_SIZE = NandImage::TOTAL_BLOCKS / 8;
+// Pending read-ahead is a hint, requests beyond this are dropped
+static constexpr size_t MAX_PREFETCH_RANGES = 1024;
+static constexpr u32 STORED_BITMAP_SIZE = NandImage::TOTAL_PAGES / 8;
+
+// Start of interleaved images and of delta files
+struct ImageHeader {
+    char magic[8];
+    u32 version;
+    u32 pageSize;
+    u32 oobSize;
+    u32 pagesPerBlock;
+    u32 totalBlocks;
+};
+static constexpr char IMAGE_MAGIC[8] = {'O', 'P', '1', 'N', 'A', 'N', 'D', 'I'};
+static constexpr u32 IMAGE_VERSION = 1;
+
+// Delta file layout, every part aligned to the host page size so that it
+// can be msynced on its own:
+//   0x0000  ImageHeader
+//   0x1000  bitmap of the pages held by the delta, one bit per page
+//   0x9000  erased block bitmap, one bit per block
+//   0xA000  sparse image, Split for version 1 and Interleaved for version 2
+static constexpr char DELTA_MAGIC[8] = {'O', 'P', '1', 'N', 'D', 'L', 'T', 'A'};
+static constexpr u32 DELTA_VERSION_SPLIT = 1;
+static constexpr u32 DELTA_VERSION = 2;
+static constexpr u64 DELTA_STORED_OFFSET = NandImage::HEADER_SIZE;
+static constexpr u64 DELTA_ERASED_OFFSET = DELTA_STORED_OFFSET + STORED_BITMAP_SIZE;
+static constexpr u64 DELTA_STORAGE_OFFSET = DELTA_ERASED_OFFSET + 0x1000;
+static constexpr u64 DELTA_SIZE = DELTA_STORAGE_OFFSET + DEVICE_SIZE;
+
+static ImageHeader MakeHeader(const char (&magic)[8], u32 version) {
+    ImageHeader header = {};
+    std::memcpy(header.magic, magic, sizeof(header.magic));
+    header.version = version;
+    header.pageSize = NandImage::PAGE_SIZE;
+    header.oobSize = NandImage::OOB_SIZE;
+    header.pagesPerBlock = NandImage::PAGES_PER_BLOCK;
+    header.totalBlocks = NandImage::TOTAL_BLOCKS;
+    return header;
+}
+
+static bool MatchesHeader(const u8* start, const char (&magic)[8], u32 version) {
+    ImageHeader expected = MakeHeader(magic, version);
+    return std::memcmp(start, &expected, sizeof(expected)) == 0;
+}
+
+// Offsets of a page's data and OOB areas from the start of the image
+static u64 DataOffset(NandLayout layout, u32 page) {
+    if (layout == NandLayout::Interleaved) {
+        return static_cast<u64>(page) * NandImage::PAGE_TOTAL_SIZE;
+    }
+    return static_cast<u64>(page) * NandImage::PAGE_SIZE;
+}
+
+static u64 OobOffset(NandLayout layout, u32 page) {
+    if (layout == NandLayout::Interleaved) {
+        return static_cast<u64>(page) * NandImage::PAGE_TOTAL_SIZE + NandImage::PAGE_SIZE;
+    }
+    return OOB_AREA_OFFSET + static_cast<u64>(page) * NandImage::OOB_SIZE;
+}
+
+// Calls `function(offset, length)` for each range of the image holding
+// `count` blocks from `first`: one for Interleaved, data and OOB for Split.
+// Every range is a multiple of the host page size.
+template <typename Function>
+static void ForEachBlockRange(NandLayout layout, u32 first, u32 count, Function function) {
+    if (layout == NandLayout::Interleaved) {
+        function(static_cast<u64>(first) * BLOCK_TOTAL_SIZE, static_cast<u64>(count) * BLOCK_TOTAL_SIZE);
+        return;
+    }
+    function(static_cast<u64>(first) * BLOCK_SIZE, static_cast<u64>(count) * BLOCK_SIZE);
+    function(OOB_AREA_OFFSET + static_cast<u64>(first) * BLOCK_OOB_SIZE, static_cast<u64>(count) * BLOCK_OOB_SIZE);
+}
+
+NandLayout NandImage::DetectLayout(int descriptor) {
+    ImageHeader header;
+    if (pread(descriptor, &header, sizeof(header), 0) == sizeof(header) &&
+        std::memcmp(header.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) == 0) {
+        return NandLayout::Interleaved;
+    }
+    return NandLayout::Split;
+}
+
+bool NandImage::HasHoles(int descriptor, u64 size) {
+    off_t hole = lseek(descriptor, 0, SEEK_HOLE);
+    return hole >= 0 && static_cast<u64>(hole) < size;
+}
+
+NandImage::NandImage(const std::string& path, const std::string& basePath) {
+    bool opened = basePath.empty() ? OpenImage(path) : OpenBase(basePath) && OpenDelta(path);
+    if (opened) {
+        flushThread = std::thread([this]() { FlushThread(); });
+        prefetchThread = std::thread([this]() { PrefetchThread(); });
+    }
+}
+
+NandImage::~NandImage() {
+    if (flushThread.joinable()) {
+        // Under both mutexes, so that neither thread can check running
+        // before the change and start waiting after the notification
+        {
+            std::scoped_lock lock(flushMutex, prefetchMutex);
+            running = false;
+        }
+        flushWakeup.notify_all();
+        prefetchWakeup.notify_all();
+        flushThread.join();
+        prefetchThread.join();
+        // Blocks modified during the flush thread's last pass
+        FlushBlocks();
+    }
+    if (mapping) {
+        msync(mapping, mappingSize, MS_SYNC);
+        munmap(mapping, mappingSize);
+    }
+    if (bitmapMapping) {
+        msync(bitmapMapping, ERASED_BITMAP_SIZE, MS_SYNC);
+        munmap(bitmapMapping, ERASED_BITMAP_SIZE);
+    }
+    if (baseMapping) {
+        munmap(const_cast<u8*>(baseMapping), baseMappingSize);
+    }
+    if (baseErasedBlocks) {
+        munmap(const_cast<u8*>(baseErasedBlocks), ERASED_BITMAP_SIZE);
+    }
+    for (int descriptor : {fd, bitmapFd, baseFd, baseBitmapFd}) {
+        if (descriptor >= 0) {
+            close(descriptor);
+        }
+    }
+}
+
+u8* NandImage::MapFile(int descriptor, u64 size, bool writable, const std::string& path) {
+    int protection = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    void* result = mmap(nullptr, size, protection, MAP_SHARED, descriptor, 0);
+    if (result == MAP_FAILED) {
+        LogError("NandImage: Failed to map %s", path.c_str());
+        return nullptr;
+    }
+    return static_cast<u8*>(result);
+}
+
+// Opens the existing image or creates a new, sparse one, and grows it to
+// the full device size
+bool NandImage::OpenImage(const std::string& path) {
+    fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        LogError("NandImage: Failed to open storage file: %s", path.c_str());
+        return false;
+    }
+    u64 fileSize = info.st_size;
+    bool created = fileSize == 0;
+    layout = created ? NandLayout::Interleaved : DetectLayout(fd);
+    u64 headerSize = layout == NandLayout::Interleaved ? HEADER_SIZE : 0;
+    u64 imageSize = headerSize + DEVICE_SIZE;
+    bool sparse = !created && HasHoles(fd, std::min(fileSize, imageSize));
+    if (fileSize < imageSize && ftruncate(fd, imageSize) != 0) {
+        LogError("NandImage: Failed to resize storage file: %s", path.c_str());
+        return false;
+    }
+    mapping = MapFile(fd, imageSize, true, path);
+    if (!mapping) {
+        return false;
+    }
+    mappingSize = imageSize;
+    if (created) {
+        ImageHeader header = MakeHeader(IMAGE_MAGIC, IMAGE_VERSION);
+        std::memcpy(mapping, &header, sizeof(header));
+        msync(mapping, HEADER_SIZE, MS_SYNC);
+    } else if (layout == NandLayout::Interleaved && !MatchesHeader(mapping, IMAGE_MAGIC, IMAGE_VERSION)) {
+        LogError("NandImage: %s is not an image for this device", path.c_str());
+        return false;
+    }
+
+    // A new image is entirely erased. Images from before the sidecar hold
+    // every block explicitly, so nothing is marked erased; bytes past the
+    // end of a short one are filled in as erased. Without its sidecar, the
+    // holes of a sparse image cannot be told from programmed blocks.
+    if (!OpenErasedBitmap(path + ERASED_BITMAP_SUFFIX, created, sparse)) {
+        if (sparse) {
+            LogError("NandImage: %s has holes but no valid %s file, restore it or fill in the holes",
+                     path.c_str(), ERASED_BITMAP_SUFFIX);
+            return false;
+        }
+        LogWarn("NandImage: No erased block bitmap, erasing in place");
+    }
+    if (fileSize < imageSize && !(created && erasedBlocks)) {
+        u64 start = std::max(fileSize, headerSize);
+        std::memset(mapping + start, ERASED_VALUE, imageSize - start);
+        msync(mapping, imageSize, MS_ASYNC);
+    }
+    storage = mapping + headerSize;
+    storageOffset = headerSize;
+    return true;
+}
+
+// Maps the sidecar bitmap, creating it (or replacing one of the wrong size)
+// with no block erased, or with every block erased if `allErased`. With
+// `mustExist`, a missing or invalid sidecar is an error instead.
+bool NandImage::OpenErasedBitmap(const std::string& path, bool allErased, bool mustExist) {
+    bitmapFd = open(path.c_str(), mustExist ? O_RDWR : O_RDWR | O_CREAT, 0644);
+    struct stat info;
+    if (bitmapFd < 0 || fstat(bitmapFd, &info) != 0) {
+        if (!mustExist) {
+            LogError("NandImage: Failed to open erased block bitmap: %s", path.c_str());
+        }
+        return false;
+    }
+    bool valid = info.st_size == ERASED_BITMAP_SIZE;
+    if (!valid) {
+        if (mustExist) {
+            return false;
+        }
+        if (info.st_size != 0) {
+            LogWarn("NandImage: Ignoring erased block bitmap of unexpected size: %s", path.c_str());
+        }
+        if (ftruncate(bitmapFd, 0) != 0 || ftruncate(bitmapFd, ERASED_BITMAP_SIZE) != 0) {
+            LogError("NandImage: Failed to resize erased block bitmap: %s", path.c_str());
+            return false;
+        }
+    }
+    bitmapMapping = MapFile(bitmapFd, ERASED_BITMAP_SIZE, true, path);
+    if (!bitmapMapping) {
+        return false;
+    }
+    if (allErased) {
+        // On disk before anything else, as the blocks are only holes
+        std::memset(bitmapMapping, 0xFF, ERASED_BITMAP_SIZE);
+        msync(bitmapMapping, ERASED_BITMAP_SIZE, MS_SYNC);
+    }
+    bitmaps.assign(bitmapMapping, bitmapMapping + ERASED_BITMAP_SIZE);
+    bitmapFile = bitmapMapping;
+    erasedBlocks = bitmaps.data();
+    return true;
+}
+
+// Maps the base image of an overlay, and its erased block bitmap if it has
+// one, read-only
+bool NandImage::OpenBase(const std::string& path) {
+    baseFd = open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if (baseFd < 0 || fstat(baseFd, &info) != 0) {
+        LogError("NandImage: Failed to open base image: %s", path.c_str());
+        return false;
+    }
+    baseLayout = DetectLayout(baseFd);
+    u64 headerSize = baseLayout == NandLayout::Interleaved ? HEADER_SIZE : 0;
+    if (static_cast<u64>(info.st_size) < headerSize + DEVICE_SIZE) {
+        LogError("NandImage: Base image %s is short, open it once without an overlay to grow it", path.c_str());
+        return false;
+    }
+    baseMapping = MapFile(baseFd, headerSize + DEVICE_SIZE, false, path);
+    if (!baseMapping) {
+        return false;
+    }
+    baseMappingSize = headerSize + DEVICE_SIZE;
+    if (baseLayout == NandLayout::Interleaved && !MatchesHeader(baseMapping, IMAGE_MAGIC, IMAGE_VERSION)) {
+        LogError("NandImage: %s is not an image for this device", path.c_str());
+        return false;
+    }
+    base = baseMapping + headerSize;
+
+    std::string bitmapPath = path + ERASED_BITMAP_SUFFIX;
+    baseBitmapFd = open(bitmapPath.c_str(), O_RDONLY);
+    if (baseBitmapFd >= 0 && fstat(baseBitmapFd, &info) == 0 && info.st_size == ERASED_BITMAP_SIZE) {
+        baseErasedBlocks = MapFile(baseBitmapFd, ERASED_BITMAP_SIZE, false, bitmapPath);
+    }
+    if (!baseErasedBlocks && HasHoles(baseFd, baseMappingSize)) {
+        LogError("NandImage: Base image %s has holes but no valid %s file", path.c_str(), ERASED_BITMAP_SUFFIX);
+        return false;
+    }
+    return true;
+}
+
+// Opens the delta file of an overlay, creating an empty one if needed. An
+// existing file that is not a delta for this geometry is left untouched.
+bool NandImage::OpenDelta(const std::string& path) {
+    fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        LogError("NandImage: Failed to open delta file: %s", path.c_str());
+        return false;
+    }
+    bool created = info.st_size == 0;
+    if (created && ftruncate(fd, DELTA_SIZE) != 0) {
+        LogError("NandImage: Failed to resize delta file: %s", path.c_str());
+        return false;
+    }
+    if (!created && static_cast<u64>(info.st_size) != DELTA_SIZE) {
+        LogError("NandImage: %s is not a NAND delta file", path.c_str());
+        return false;
+    }
+    mapping = MapFile(fd, DELTA_SIZE, true, path);
+    if (!mapping) {
+        return false;
+    }
+    mappingSize = DELTA_SIZE;
+
+    if (created) {
+        ImageHeader header = MakeHeader(DELTA_MAGIC, DELTA_VERSION);
+        std::memcpy(mapping, &header, sizeof(header));
+        msync(mapping, HEADER_SIZE, MS_SYNC);
+        layout = NandLayout::Interleaved;
+    } else if (MatchesHeader(mapping, DELTA_MAGIC, DELTA_VERSION)) {
+        layout = NandLayout::Interleaved;
+    } else if (MatchesHeader(mapping, DELTA_MAGIC, DELTA_VERSION_SPLIT)) {
+        layout = NandLayout::Split;
+    } else {
+        LogError("NandImage: %s is not a NAND delta file for this device", path.c_str());
+        return false;
+    }
+
+    bitmapFile = mapping + DELTA_STORED_OFFSET;
+    bitmaps.assign(bitmapFile, bitmapFile + STORED_BITMAP_SIZE + ERASED_BITMAP_SIZE);
+    storedPages = bitmaps.data();
+    erasedBlocks = bitmaps.data() + STORED_BITMAP_SIZE;
+    storage = mapping + DELTA_STORAGE_OFFSET;
+    storageOffset = DELTA_STORAGE_OFFSET;
+    return true;
+}
+
+void NandImage::SetBit(u8* bitmap, u32 index, bool value) {
+    u8 bit = 1 << (index % 8);
+    if (value) {
+        bitmap[index / 8] |= bit;
+    } else {
+        bitmap[index / 8] &= ~bit;
+    }
+}
+
+bool NandImage::IsStored(u32 page) const {
+    if (storedPages) {
+        return TestBit(storedPages, page);
+    }
+    return !IsErased(page / PAGES_PER_BLOCK);
+}
+
+bool NandImage::IsModified(u32 block) const {
+    if (!storedPages || block >= TOTAL_BLOCKS) {
+        return false;
+    }
+    const u8* bits = storedPages + block * (PAGES_PER_BLOCK / 8);
+    for (u32 i = 0; i < PAGES_PER_BLOCK / 8; i++) {
+        if (bits[i]) {
+            return true;
+        }
+    }
+    return IsErased(block);
+}
+
+void NandImage::Page(u32 page, const u8*& data, const u8*& oob) const {
+    data = nullptr;
+    oob = nullptr;
+    if (page >= TOTAL_PAGES || !storage) {
+        return;
+    }
+    u32 block = page / PAGES_PER_BLOCK;
+    if (IsStored(page)) {
+        data = storage + DataOffset(layout, page);
+        oob = storage + OobOffset(layout, page);
+    } else if (base && !IsErased(block) && !(baseErasedBlocks && TestBit(baseErasedBlocks, block))) {
+        data = base + DataOffset(baseLayout, page);
+        oob = base + OobOffset(baseLayout, page);
+    }
+}
+
+// Writes out an erased block so that its pages can be programmed in place.
+// Under flushMutex, so that a flush either still finds the block erased and
+// does not punch it, or syncs the new contents before unmarking it.
+void NandImage::FillBlock(u32 block) {
+    std::lock_guard<std::mutex> lock(flushMutex);
+    ForEachBlockRange(layout, block, 1, [this](u64 offset, u64 length) {
+        std::memset(storage + offset, ERASED_VALUE, length);
+    });
+    SetBit(erasedBlocks, block, false);
+    if (storedPages) {
+        std::memset(storedPages + block * (PAGES_PER_BLOCK / 8), 0xFF, PAGES_PER_BLOCK / 8);
+    }
+    dirtyBlocks.insert(block);
+}
+
+void NandImage::Program(u32 page, const u8* buffer) {
+    if (page >= TOTAL_PAGES || !storage) {
+        return;
+    }
+    u32 block = page / PAGES_PER_BLOCK;
+    u8* data = storage + DataOffset(layout, page);
+    u8* oob = storage + OobOffset(layout, page);
+    if (IsErased(block)) {
+        // The first program after an erase fills in the block
+        FillBlock(block);
+    } else if (!IsStored(page)) {
+        // Overlay: copy the page up from the base before changing it
+        const u8* baseData;
+        const u8* baseOob;
+        Page(page, baseData, baseOob);
+        if (baseData) {
+            std::memcpy(data, baseData, PAGE_SIZE);
+            std::memcpy(oob, baseOob, OOB_SIZE);
+        } else {
+            std::memset(data, ERASED_VALUE, PAGE_SIZE);
+            std::memset(oob, ERASED_VALUE, OOB_SIZE);
+        }
+        std::lock_guard<std::mutex> lock(flushMutex);
+        SetBit(storedPages, page, true);
+        dirtyBlocks.insert(block);
+    }
+
+    // Program operation: AND with the buffer, bits can only be cleared
+    for (u32 i = 0; i < PAGE_SIZE; ++i) {
+        data[i] &= buffer[i];
+    }
+    for (u32 i = 0; i < OOB_SIZE; ++i) {
+        oob[i] &= buffer[PAGE_SIZE + i];
+    }
+    std::unique_lock<std::mutex> lock(flushMutex);
+    MarkDirty(block, lock);
+}
+
+void NandImage::Erase(u32 block) {
+    if (block >= TOTAL_BLOCKS || !storage) {
+        return;
+    }
+
+    // With the bitmap the old contents are only dropped to free disk space,
+    // which FlushBlocks does once the mark is on disk
+    if (erasedBlocks) {
+        std::unique_lock<std::mutex> lock(flushMutex);
+        SetBit(erasedBlocks, block, true);
+        if (storedPages) {
+            std::memset(storedPages + block * (PAGES_PER_BLOCK / 8), 0, PAGES_PER_BLOCK / 8);
+        }
+        MarkDirty(block, lock);
+    } else {
+        ForEachBlockRange(layout, block, 1, [this](u64 offset, u64 length) {
+            std::memset(storage + offset, ERASED_VALUE, length);
+        });
+        std::unique_lock<std::mutex> lock(flushMutex);
+        MarkDirty(block, lock);
+    }
+}
+
+// Called with flushMutex held through `lock`
+void NandImage::MarkDirty(u32 block, std::unique_lock<std::mutex>& lock) {
+    dirtyBlocks.insert(block);
+    lastModified = std::chrono::steady_clock::now();
+    if (durability == NandDurability::Synchronous) {
+        lock.unlock();
+        FlushBlocks();
+    }
+}
+
+void NandImage::SetDurability(NandDurability policy, std::chrono::milliseconds interval) {
+    {
+        std::lock_guard<std::mutex> lock(flushMutex);
+        durability = policy;
+        flushInterval = interval;
+    }
+    flushWakeup.notify_all();
+    if (policy == NandDurability::Synchronous) {
+        Flush();
+    }
+}
+
+void NandImage::Flush() {
+    std::unique_lock<std::mutex> lock(flushMutex);
+    if (!flushThread.joinable()) {
+        return;
+    }
+    u64 request = ++flushRequests;
+    flushWakeup.notify_all();
+    flushDone.wait(lock, [&]() { return flushesDone >= request; });
+}
+
+void NandImage::FlushThread() {
+    std::unique_lock<std::mutex> lock(flushMutex);
+    while (running) {
+        auto now = std::chrono::steady_clock::now();
+        auto deadline = now + flushInterval;
+        if (durability == NandDurability::Idle && !dirtyBlocks.empty()) {
+            deadline = lastModified + flushInterval;
+        }
+        flushWakeup.wait_until(lock, deadline, [this]() { return !running || flushRequests > flushesDone; });
+
+        // Idle writes back only once the writes have stopped for a full
+        // interval; an explicit flush or shutdown always does
+        u64 requests = flushRequests;
+        bool due = !running || requests > flushesDone;
+        if (durability == NandDurability::Periodic) {
+            due = due || std::chrono::steady_clock::now() >= deadline;
+        } else if (durability == NandDurability::Idle) {
+            due = due || std::chrono::steady_clock::now() >= lastModified + flushInterval;
+        }
+        if (!due) {
+            continue;
+        }
+        lock.unlock();
+        FlushBlocks();
+        lock.lock();
+        flushesDone = requests;
+        flushDone.notify_all();
+    }
+}
+
+// Writes the blocks modified since the last call back in three steps: the
+// image ranges of the blocks, merging runs of consecutive blocks into one
+// msync per range; then the bitmaps as they were when the blocks were
+// collected, which only describe data already on disk; then the holes of
+// the blocks whose erase is now on disk. Block ranges are multiples of the
+// host page size, so they stay page aligned.
+void NandImage::FlushBlocks() {
+    std::lock_guard<std::mutex> syncLock(syncMutex);
+    std::set<u32> blocks;
+    std::vector<u8> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(flushMutex);
+        blocks.swap(dirtyBlocks);
+        snapshot = bitmaps;
+    }
+    if (blocks.empty()) {
+        return;
+    }
+    for (auto it = blocks.begin(); it != blocks.end();) {
+        u32 first = *it;
+        u32 count = 1;
+        while (++it != blocks.end() && *it == first + count) {
+            count++;
+        }
+        ForEachBlockRange(layout, first, count, [this](u64 offset, u64 length) {
+            msync(storage + offset, length, MS_SYNC);
+        });
+    }
+    if (!bitmapFile) {
+        return;
+    }
+    std::memcpy(bitmapFile, snapshot.data(), snapshot.size());
+    msync(bitmapFile, snapshot.size(), MS_SYNC);
+
+    // A block programmed since the snapshot is no longer erased and keeps
+    // its data. Punching failures are harmless, the bitmap is what counts.
+    const u8* erasedOnDisk = snapshot.data() + (storedPages ? STORED_BITMAP_SIZE : 0);
+    for (u32 block : blocks) {
+        std::lock_guard<std::mutex> lock(flushMutex);
+        if (TestBit(erasedOnDisk, block) && IsErased(block)) {
+            ForEachBlockRange(layout, block, 1, [this](u64 offset, u64 length) {
+                fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, storageOffset + offset, length);
+            });
+        }
+    }
+}
+
+void NandImage::Prefetch(u32 firstPage, u32 count) {
+    if (!prefetchThread.joinable()) {
+        return;
+    }
+    // Resolve the pages here, where the bitmaps are not changing under us.
+    // Erasing a page afterwards only leaves its range pointing at a hole.
+    std::lock_guard<std::mutex> lock(prefetchMutex);
+    auto queue = [this](const u8* start, u32 length) {
+        if (!prefetchRanges.empty() && prefetchRanges.back().start + prefetchRanges.back().length == start) {
+            prefetchRanges.back().length += length;
+        } else if (prefetchRanges.size() < MAX_PREFETCH_RANGES) {
+            prefetchRanges.push_back({start, length});
+        }
+    };
+    for (u32 page = firstPage; page < firstPage + count && page < TOTAL_PAGES; page++) {
+        const u8* data;
+        const u8* oob;
+        Page(page, data, oob);
+        if (data) {
+            queue(data, PAGE_SIZE);
+            queue(oob, OOB_SIZE);
+        }
+    }
+    prefetchWakeup.notify_one();
+}
+
+// Populates the page tables for the queued ranges, so that the faults, and
+// the disk reads behind them, happen on this thread. Kernels without
+// MADV_POPULATE_READ only get an asynchronous read-ahead. The mappings
+// outlive the thread, so the ranges stay valid.
+void NandImage::PrefetchThread() {
+    bool populate = true;
+    uintptr_t hostPageMask = sysconf(_SC_PAGESIZE) - 1;
+    std::unique_lock<std::mutex> lock(prefetchMutex);
+    while (running) {
+        prefetchWakeup.wait(lock, [this]() { return !running || !prefetchRanges.empty(); });
+        while (running && !prefetchRanges.empty()) {
+            PrefetchRange range = prefetchRanges.front();
+            prefetchRanges.pop_front();
+            lock.unlock();
+            uintptr_t first = reinterpret_cast<uintptr_t>(range.start) & ~hostPageMask;
+            size_t length = reinterpret_cast<uintptr_t>(range.start) + range.length - first;
+            void* address = reinterpret_cast<void*>(first);
+            if (populate && madvise(address, length, MADV_POPULATE_READ) != 0 && errno == EINVAL) {
+                populate = false;
+            }
+            if (!populate) {
+                madvise(address, length, MADV_WILLNEED);
+            }
+            lock.lock();
+        }
+    }
+}
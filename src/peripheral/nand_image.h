@@ -0,0 +1,172 @@
+#pragma once
+
+#include "common.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// When programs and erases reach the storage file
+enum class NandDurability {
+    Periodic,    // every flush interval
+    Idle,        // once nothing has been written for a flush interval
+    Synchronous, // before the program or erase completes
+};
+
+// On-disk arrangement of the pages of an image
+enum class NandLayout {
+    Split,       // all data areas, then all OOB areas (images without a header)
+    Interleaved, // each data area followed by its OOB area, after a header
+};
+
+// Backing store of the MT29F4G08: 4096 blocks of 64 pages, each page a
+// 2048-byte data area plus a 64-byte OOB area.
+//
+// New images are Interleaved, so a page is one contiguous 2112-byte range
+// and a block one page-aligned 132 KiB range. Split images from before the
+// header are detected and keep working; tools/nandconvert.cpp converts them.
+//
+// The image file is memory-mapped: pages are read straight from the mapping
+// and programs/erases modify it in place, so the host page cache acts as a
+// write-back cache. A background thread msyncs the blocks touched since its
+// last pass as the durability policy asks, and another one faults in pages
+// ahead of sequential reads.
+//
+// Images are sparse. A sidecar file (<image>.erased) holds one bit per
+// block that is set while the block is erased; such blocks read as erased
+// whatever the image holds there, and are only filled in when a page of
+// them is programmed. Erasing punches a hole instead of writing 0xFF. An
+// image with holes is only opened with a valid sidecar, as the holes read
+// as 0x00, which the firmware takes for bad block markers.
+//
+// Bitmaps are changed in memory and written to their files by the flush
+// thread only after the block data they describe has been msynced, so a
+// crash never leaves a block marked as holding data it does not hold: a
+// block written after an erase is unmarked only once its data is on disk,
+// and an erased block is marked before its hole is punched.
+//
+// In overlay mode the image is a read-only base shared between instances,
+// and every change goes to a per-instance delta file (laid out in
+// nand_image.cpp) that holds modified pages at their image offsets, with a
+// bitmap of the pages it holds and its own erased block bitmap. The base
+// and the delta may each use either layout.
+class NandImage {
+public:
+    static constexpr u32 PAGE_SIZE = 2048;
+    static constexpr u32 OOB_SIZE = 64;
+    static constexpr u32 PAGE_TOTAL_SIZE = PAGE_SIZE + OOB_SIZE;
+    static constexpr u32 PAGES_PER_BLOCK = 64;
+    static constexpr u32 TOTAL_BLOCKS = 4096;
+    static constexpr u32 TOTAL_PAGES = TOTAL_BLOCKS * PAGES_PER_BLOCK;
+    static constexpr u8 ERASED_VALUE = 0xFF;
+    // Interleaved images start with a header of this size
+    static constexpr u64 HEADER_SIZE = 0x1000;
+    static constexpr const char* ERASED_BITMAP_SUFFIX = ".erased";
+
+    // Opens or creates the image at `path`. With a `basePath`, `path` is
+    // the delta file of an overlay on that image instead.
+    NandImage(const std::string& path, const std::string& basePath = "");
+    ~NandImage();
+    NandImage(const NandImage&) = delete;
+    NandImage& operator=(const NandImage&) = delete;
+
+    bool IsOpen() const { return storage != nullptr; }
+    bool IsOverlay() const { return base != nullptr; }
+    // Layout of the image file at `fd`, from its header
+    static NandLayout DetectLayout(int fd);
+    // The first `size` bytes of the file at `fd` contain a hole
+    static bool HasHoles(int fd, u64 size);
+
+    // Data and OOB areas of `page`, or nullptr for both if the page is
+    // erased or out of range. They point into the mapping and follow later
+    // programs of the page until its block is erased.
+    void Page(u32 page, const u8*& data, const u8*& oob) const;
+    // ANDs PAGE_TOTAL_SIZE bytes (data area, then OOB area) into `page`
+    void Program(u32 page, const u8* buffer);
+    void Erase(u32 block);
+    // Overlay only: the delta holds changes to `block`
+    bool IsModified(u32 block) const;
+    // Reads `count` pages from `firstPage` into memory on the read-ahead
+    // thread, so that reading them later does not wait for the disk. Call
+    // from the thread that programs and erases.
+    void Prefetch(u32 firstPage, u32 count);
+
+    void SetDurability(NandDurability policy, std::chrono::milliseconds interval = std::chrono::seconds(1));
+    // Writes every modified block back to the image file and waits for it.
+    // Safe to call from any thread.
+    void Flush();
+
+private:
+    bool OpenImage(const std::string& path);
+    bool OpenDelta(const std::string& path);
+    bool OpenBase(const std::string& path);
+    bool OpenErasedBitmap(const std::string& path, bool allErased, bool mustExist);
+    u8* MapFile(int fd, u64 size, bool writable, const std::string& path);
+
+    bool IsErased(u32 block) const { return erasedBlocks && TestBit(erasedBlocks, block); }
+    // The page's current contents are in `storage`
+    bool IsStored(u32 page) const;
+    void FillBlock(u32 block);
+    void MarkDirty(u32 block, std::unique_lock<std::mutex>& lock);
+    void FlushThread();
+    void FlushBlocks();
+    void PrefetchThread();
+
+    static bool TestBit(const u8* bitmap, u32 index) { return (bitmap[index / 8] >> (index % 8)) & 1; }
+    static void SetBit(u8* bitmap, u32 index, bool value);
+
+    // Writable image: the part of the file after the header, and after the
+    // bitmaps for a delta. It starts at storageOffset in the file.
+    NandLayout layout = NandLayout::Interleaved;
+    int fd = -1;
+    u8* mapping = nullptr;
+    u64 mappingSize = 0;
+    u8* storage = nullptr;
+    u64 storageOffset = 0;
+    // Bitmaps as the image is now, changed under flushMutex: the erased
+    // block bitmap, after the stored pages bitmap for a delta. bitmapFile is
+    // their copy on disk, the sidecar of a plain image or inside the delta.
+    std::vector<u8> bitmaps;
+    u8* bitmapFile = nullptr;
+    int bitmapFd = -1;
+    u8* bitmapMapping = nullptr;
+    u8* erasedBlocks = nullptr; // nullptr to erase in place
+    // Overlay only: pages held by the delta, and the read-only base image
+    u8* storedPages = nullptr;
+    NandLayout baseLayout = NandLayout::Split;
+    int baseFd = -1;
+    const u8* baseMapping = nullptr;
+    u64 baseMappingSize = 0;
+    const u8* base = nullptr;
+    int baseBitmapFd = -1;
+    const u8* baseErasedBlocks = nullptr;
+
+    // Write-back state, guarded by flushMutex
+    std::set<u32> dirtyBlocks; // modified since the last msync
+    std::chrono::steady_clock::time_point lastModified;
+    NandDurability durability = NandDurability::Periodic;
+    std::chrono::milliseconds flushInterval = std::chrono::seconds(1);
+    u64 flushRequests = 0; // Flush() calls, and how many have been served
+    u64 flushesDone = 0;
+    std::atomic<bool> running{true};
+    std::thread flushThread;
+    std::mutex flushMutex;
+    std::mutex syncMutex; // held through FlushBlocks
+    std::condition_variable flushWakeup;
+    std::condition_variable flushDone;
+
+    // Read-ahead state, guarded by prefetchMutex
+    struct PrefetchRange {
+        const u8* start;
+        u32 length;
+    };
+    std::deque<PrefetchRange> prefetchRanges;
+    std::thread prefetchThread;
+    std::mutex prefetchMutex;
+    std::condition_variable prefetchWakeup;
+};
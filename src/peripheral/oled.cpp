@@ -6,9 +6,10 @@ static constexpr int RS_PIN = 1;
 static constexpr int RD_PIN = 2;
 static constexpr int WR_PIN = 3;
 static constexpr int PIN_COUNT = WR_PIN + 1;
+static constexpr u32 DATA_MASK = (1u << OLED::DATA_PINS) - 1;
 
-OLED::OLED(std::array<GPIOConnection, OLED::DATA_PINS> bus, GPIOConnection cs, GPIOConnection rs, GPIOConnection rd, GPIOConnection wr)
-    : dataBus(bus) {
+OLED::OLED(GPIOPeripheral& dataPort, GPIOConnection cs, GPIOConnection rs, GPIOConnection rd, GPIOConnection wr)
+    : dataPort(dataPort) {
     // Connect control pins
     Connect(CS_PIN, cs);
     Connect(RS_PIN, rs);
@@ -27,6 +28,9 @@ OLED::OLED(std::array<GPIOConnection, OLED::DATA_PINS> bus, GPIOConnection cs, G
     for (u32 i = 0xf30; i <= 0xf41; i++) {
         REG32(REG_GAMMA_SETTINGS, i);
     }
+    for (auto& [addr, reg] : registers) {
+        registerTable[addr - REGISTER_BASE] = &reg;
+    }
 }
 
 GPIOPinDirection OLED::GetDirection(int pin) const {
@@ -42,23 +46,11 @@ GPIOPinLevel OLED::GetPinOutput(int pin) const {
 }
 
 u32 OLED::ReadFromBus() const {
-    u32 value = 0;
-    for (int i = 0; i < DATA_PINS; i++) {
-        auto& [conn, pin] = dataBus[i];
-        GPIOPinLevel level = conn.GetPinOutput(pin);
-        if (level == GPIOPinLevel::High) {
-            value |= (1 << i);
-        }
-    }
-    return value;
+    return dataPort.GetPortOutput() & DATA_MASK;
 }
 
 void OLED::WriteToBus(u32 value) const {
-    for (int i = 0; i < DATA_PINS; i++) {
-        auto& [conn, pin] = dataBus[i];
-        GPIOPinLevel level = (value & (1 << i)) ? GPIOPinLevel::High : GPIOPinLevel::Low;
-        conn.SetPinInput(pin, level);
-    }
+    dataPort.SetPortInput(value, DATA_MASK);
 }
 
 bool OLED::SetPinInput(int pin, GPIOPinLevel level) {
@@ -99,9 +91,9 @@ bool OLED::SetPinInput(int pin, GPIOPinLevel level) {
             // Perform write operation
             if (registerSelection) {
                 // Register select
-                auto iter = registers.find(data);
-                if (iter != registers.end()) {
-                    selectedRegister = &iter->second;
+                u32 index = data - REGISTER_BASE;
+                if (index < registerTable.size() && registerTable[index]) {
+                    selectedRegister = registerTable[index];
                 }
             } else {
                 // Data write
@@ -10,7 +10,9 @@ class OLED : public GPIOPeripheral {
 public:
     constexpr static int DATA_PINS = 16;
 
-    OLED(std::array<GPIOConnection, DATA_PINS> bus, GPIOConnection cs, GPIOConnection rs, GPIOConnection rd, GPIOConnection wr);
+    // The data bus is pins 0..DATA_PINS-1 of `dataPort`, read and driven as
+    // one word per strobe
+    OLED(GPIOPeripheral& dataPort, GPIOConnection cs, GPIOConnection rs, GPIOConnection rd, GPIOConnection wr);
 
     GPIOPinDirection GetDirection(int pin) const override;
     bool SetPinInput(int pin, GPIOPinLevel level) override;
@@ -27,7 +29,10 @@ protected:
     bool read = false;
     bool write = false;
     std::map<u32, Register> registers;
+    // Register select index: registers live at REGISTER_BASE + 0x00..0xFF
+    constexpr static u32 REGISTER_BASE = 0xF00;
+    std::array<Register*, 0x100> registerTable = {};
 
-    std::array<GPIOConnection, DATA_PINS> dataBus;
+    GPIOPeripheral& dataPort;
     Register* selectedRegister = nullptr;
 };
\ No newline at end of file
@@ -0,0 +1,59 @@
+#include "wav_audio_input.h"
+#include "utils/log.h"
+#include "utils/pcm.h"
+#include "utils/resampler.h"
+#include "utils/wav.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Input frames queued in the resampler at a time, and output frames
+// converted at a time
+static constexpr size_t PUSH_FRAMES = 1024;
+static constexpr size_t SCRATCH_FRAMES = 1024;
+
+WavAudioInput::WavAudioInput(const std::string& path, bool loop)
+    : loop(loop), resampler(PUSH_FRAMES), scratch(SCRATCH_FRAMES * 2) {
+    if (!LoadWav(path, frames, fileRate)) {
+        frames.clear();
+        return;
+    }
+    LogInfo("Audio input: %s, %zu frames at %dHz%s", path.c_str(), frames.size() / 2, fileRate, loop ? ", looped" : "");
+}
+
+size_t WavAudioInput::ReadSamples(void* data, size_t samples, int channels, int bitsPerSample, uint32_t sampleRate) {
+    FloatToPCMFn convert = SelectFloatToPCM(channels, bitsPerSample);
+    size_t frameSize = (bitsPerSample > 16 ? 4 : 2) * channels;
+    uint8_t* dest = static_cast<uint8_t*>(data);
+    size_t count = frames.size() / 2;
+
+    // The resampler is only topped up once it cannot produce a frame, so it
+    // never holds more than a step and PUSH_FRAMES
+    double step = (double)fileRate / sampleRate;
+    if (sampleRate != outputRate) {
+        outputRate = sampleRate;
+        resampler = CubicResampler(PUSH_FRAMES + (size_t)std::ceil(step) + 8);
+    }
+
+    size_t done = 0;
+    while (done < samples) {
+        size_t available = resampler.Available(step);
+        if (available == 0) {
+            if (position == count) {
+                break;
+            }
+            size_t n = std::min(PUSH_FRAMES, count - position);
+            resampler.Push(frames.data() + position * 2, n);
+            position += n;
+            if (position == count && loop) {
+                position = 0;
+            }
+            continue;
+        }
+        size_t n = resampler.Pull(scratch.data(), std::min({samples - done, available, SCRATCH_FRAMES}), step);
+        convert(dest + done * frameSize, scratch.data(), n);
+        done += n;
+    }
+    memset(dest + done * frameSize, 0, (samples - done) * frameSize); // Past the end: silence
+    return samples;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "audio_input.h"
+#include "utils/resampler.h"
+#include <string>
+#include <vector>
+
+// Plays a WAV file into the SPORT receive path, e.g. to test sampling
+// without a capture device. The file is decoded up front and resampled to
+// the SPORT's frame rate as it is read.
+class WavAudioInput : public AudioInput {
+public:
+    WavAudioInput(const std::string& path, bool loop);
+
+    bool IsLoaded() const { return !frames.empty(); }
+    size_t ReadSamples(void* data, size_t samples, int channels, int bitsPerSample, uint32_t sampleRate) override;
+
+private:
+    std::vector<float> frames; // interleaved float stereo at fileRate
+    uint32_t fileRate = 0;
+    size_t position = 0;       // next frame to queue in the resampler
+    bool loop;
+
+    CubicResampler resampler;
+    uint32_t outputRate = 0;   // rate the resampler was sized for
+    std::vector<float> scratch;
+};
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// 64-bit non-cryptographic hash, bit-compatible with XXH64. The bulk loop
+// runs four independent lanes, so large buffers such as display frames hash
+// at several GB/s. Used to compare frames and images, not for security.
+uint64_t Hash64(const void* data, size_t length, uint64_t seed = 0);
@@ -0,0 +1,345 @@
+#include "pcm.h"
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PCM_HAVE_AVX2 1
+#endif
+
+// Powers of two, so multiplying is exact and matches a divide
+static constexpr float SCALE_16 = 1.0f / 32768.0f;
+static constexpr float SCALE_24 = 1.0f / 8388608.0f;
+
+static inline float Sample16(const uint8_t* p)
+{
+    int16_t sample;
+    memcpy(&sample, p, sizeof(sample));
+    return sample * SCALE_16;
+}
+
+static inline float Sample24(const uint8_t* p)
+{
+    uint32_t word;
+    memcpy(&word, p, sizeof(word));
+    int32_t sample = (int32_t)(word << 8) >> 8; // sign-extend from 24-bit
+    return sample * SCALE_24;
+}
+
+// Scalar versions, also used for the tails of the vector loops. Stereo
+// conversion is sample-wise, so it takes a sample count rather than frames.
+template <float (*Sample)(const uint8_t*), int WordSize>
+static void ConvertScalar(float* dest, const uint8_t* src, size_t samples)
+{
+    for (size_t i = 0; i < samples; i++) {
+        dest[i] = Sample(src + i * WordSize);
+    }
+}
+
+template <float (*Sample)(const uint8_t*), int WordSize>
+static void DuplicateScalar(float* dest, const uint8_t* src, size_t frames)
+{
+    for (size_t i = 0; i < frames; i++) {
+        dest[2 * i] = dest[2 * i + 1] = Sample(src + i * WordSize);
+    }
+}
+
+static void S16StereoScalar(float* dest, const void* src, size_t frames)
+{
+    ConvertScalar<Sample16, 2>(dest, static_cast<const uint8_t*>(src), frames * 2);
+}
+
+static void S16MonoScalar(float* dest, const void* src, size_t frames)
+{
+    DuplicateScalar<Sample16, 2>(dest, static_cast<const uint8_t*>(src), frames);
+}
+
+static void S24StereoScalar(float* dest, const void* src, size_t frames)
+{
+    ConvertScalar<Sample24, 4>(dest, static_cast<const uint8_t*>(src), frames * 2);
+}
+
+static void S24MonoScalar(float* dest, const void* src, size_t frames)
+{
+    DuplicateScalar<Sample24, 4>(dest, static_cast<const uint8_t*>(src), frames);
+}
+
+#if defined(__SSE2__)
+static inline __m128 Load16x4(const uint8_t* p, bool high)
+{
+    __m128i v = _mm_loadu_si128((const __m128i*)p);
+    v = high ? _mm_unpackhi_epi16(v, v) : _mm_unpacklo_epi16(v, v);
+    return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(v, 16)), _mm_set1_ps(SCALE_16));
+}
+
+static inline __m128 Load24x4(const uint8_t* p)
+{
+    __m128i v = _mm_loadu_si128((const __m128i*)p);
+    v = _mm_srai_epi32(_mm_slli_epi32(v, 8), 8);
+    return _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(SCALE_24));
+}
+
+static inline void StoreDuplicated(float* dest, __m128 f)
+{
+    _mm_storeu_ps(dest, _mm_unpacklo_ps(f, f));
+    _mm_storeu_ps(dest + 4, _mm_unpackhi_ps(f, f));
+}
+
+static void S16StereoSSE2(float* dest, const void* source, size_t frames)
+{
+    auto src = static_cast<const uint8_t*>(source);
+    size_t samples = frames * 2, i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        _mm_storeu_ps(dest + i, Load16x4(src + i * 2, false));
+        _mm_storeu_ps(dest + i + 4, Load16x4(src + i * 2, true));
+    }
+    ConvertScalar<Sample16, 2>(dest + i, src + i * 2, samples - i);
+}
+
+static void S16MonoSSE2(float* dest, const void* source, size_t frames)
+{
+    auto src = static_cast<const uint8_t*>(source);
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        StoreDuplicated(dest + i * 2, Load16x4(src + i * 2, false));
+        StoreDuplicated(dest + i * 2 + 8, Load16x4(src + i * 2, true));
+    }
+    DuplicateScalar<Sample16, 2>(dest + i * 2, src + i * 2, frames - i);
+}
+
+static void S24StereoSSE2(float* dest, const void* source, size_t frames)
+{
+    auto src = static_cast<const uint8_t*>(source);
+    size_t samples = frames * 2, i = 0;
+    for (; i + 4 <= samples; i += 4) {
+        _mm_storeu_ps(dest + i, Load24x4(src + i * 4));
+    }
+    ConvertScalar<Sample24, 4>(dest + i, src + i * 4, samples - i);
+}
+
+static void S24MonoSSE2(float* dest, const void* source, size_t frames)
+{
+    auto src = static_cast<const uint8_t*>(source);
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        StoreDuplicated(dest + i * 2, Load24x4(src + i * 4));
+    }
+    DuplicateScalar<Sample24, 4>(dest + i * 2, src + i * 4, frames - i);
+}
+#endif
+
+#if defined(PCM_HAVE_AVX2)
+#define PCM_TARGET_AVX2 __attribute__((target("avx2")))
+
+PCM_TARGET_AVX2 static inline __m256 Load16x8(const uint8_t* p)
+{
+    __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)p));
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(v), _mm256_set1_ps(SCALE_16));
+}
+
+PCM_TARGET_AVX2 static inline __m256 Load24x8(const uint8_t* p)
+{
+    __m256i v = _mm256_loadu_si256((const __m256i*)p);
+    v = _mm256_srai_epi32(_mm256_slli_epi32(v, 8), 8);
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(v), _mm256_set1_ps(SCALE_24));
+}
+
+PCM_TARGET_AVX2 static inline void StoreDuplicated(float* dest, __m256 f)
+{
+    __m256 lo = _mm256_unpacklo_ps(f, f); // a0 a0 a1 a1 | a4 a4 a5 a5
+    __m256 hi = _mm256_unpackhi_ps(f, f); // a2 a2 a3 a3 | a6 a6 a7 a7
+    _mm256_storeu_ps(dest, _mm256_permute2f128_ps(lo, hi, 0x20));
+    _mm256_storeu_ps(dest + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+}
+
+PCM_TARGET_AVX2 static void S16StereoAVX2(float* dest, const void* source, size_t frames)
+{
+    auto src = static_cast<const uint8_t*>(source);
+    size_t samples = frames * 2, i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        _mm256_storeu_ps(dest + i, Load16x8(src + i * 2));
+    }
+    ConvertScalar<Sample16, 2>(dest + i, src + i * 2, samples - i);
+}
+
+PCM_TARGET_AVX2 static void S16MonoAVX2(float* dest, const void* source, size_t frames)
+{
+    auto src = static_cast<const uint8_t*>(source);
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        StoreDuplicated(dest + i * 2, Load16x8(src + i * 2));
+    }
+    DuplicateScalar<Sample16, 2>(dest + i * 2, src + i * 2, frames - i);
+}
+
+PCM_TARGET_AVX2 static void S24StereoAVX2(float* dest, const void* source, size_t frames)
+{
+    auto src = static_cast<const uint8_t*>(source);
+    size_t samples = frames * 2, i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        _mm256_storeu_ps(dest + i, Load24x8(src + i * 4));
+    }
+    ConvertScalar<Sample24, 4>(dest + i, src + i * 4, samples - i);
+}
+
+PCM_TARGET_AVX2 static void S24MonoAVX2(float* dest, const void* source, size_t frames)
+{
+    auto src = static_cast<const uint8_t*>(source);
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        StoreDuplicated(dest + i * 2, Load24x8(src + i * 4));
+    }
+    DuplicateScalar<Sample24, 4>(dest + i * 2, src + i * 4, frames - i);
+}
+#endif
+
+enum class ISA { Scalar, SSE2, AVX2 };
+
+static ISA DetectISA()
+{
+#if defined(PCM_HAVE_AVX2)
+    if (__builtin_cpu_supports("avx2")) return ISA::AVX2;
+#endif
+#if defined(__SSE2__)
+    return ISA::SSE2;
+#else
+    return ISA::Scalar;
+#endif
+}
+
+PCMToFloatFn SelectPCMToFloat(int channels, int bitsPerSample)
+{
+    static const ISA isa = DetectISA();
+    bool wide = bitsPerSample > 16;
+    bool mono = channels < 2;
+    // Indexed by [wide][mono]
+    PCMToFloatFn table[2][2] = {
+        {S16StereoScalar, S16MonoScalar},
+        {S24StereoScalar, S24MonoScalar},
+    };
+#if defined(PCM_HAVE_AVX2)
+    if (isa == ISA::AVX2) {
+        table[0][0] = S16StereoAVX2; table[0][1] = S16MonoAVX2;
+        table[1][0] = S24StereoAVX2; table[1][1] = S24MonoAVX2;
+    }
+#endif
+#if defined(__SSE2__)
+    if (isa == ISA::SSE2) {
+        table[0][0] = S16StereoSSE2; table[0][1] = S16MonoSSE2;
+        table[1][0] = S24StereoSSE2; table[1][1] = S24MonoSSE2;
+    }
+#endif
+    return table[wide][mono];
+}
+
+// Float to PCM. The scalar rounding (lrintf) matches _mm_cvtps_epi32 under
+// the default round-to-nearest-even mode.
+template <typename T, int Bits>
+static inline T Quantize(float value)
+{
+    constexpr float scale = (float)(1 << (Bits - 1));
+    float v = std::min(std::max(value * scale, -scale), scale - 1.0f);
+    return (T)lrintf(v);
+}
+
+template <typename T, int Bits>
+static void StereoFromFloatScalar(T* dest, const float* src, size_t samples)
+{
+    for (size_t i = 0; i < samples; i++) {
+        dest[i] = Quantize<T, Bits>(src[i]);
+    }
+}
+
+template <typename T, int Bits>
+static void MonoFromFloatScalar(T* dest, const float* src, size_t frames)
+{
+    for (size_t i = 0; i < frames; i++) {
+        dest[i] = Quantize<T, Bits>((src[2 * i] + src[2 * i + 1]) * 0.5f);
+    }
+}
+
+#if defined(__SSE2__)
+template <int Bits>
+static inline __m128i QuantizeX4(__m128 value)
+{
+    constexpr float scale = (float)(1 << (Bits - 1));
+    __m128 v = _mm_mul_ps(value, _mm_set1_ps(scale));
+    v = _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-scale)), _mm_set1_ps(scale - 1.0f));
+    return _mm_cvtps_epi32(v);
+}
+
+// Averages the L/R pairs of 8 interleaved floats into 4 mono samples
+static inline __m128 MixX4(const float* src)
+{
+    __m128 a = _mm_loadu_ps(src);
+    __m128 b = _mm_loadu_ps(src + 4);
+    __m128 left = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+    __m128 right = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+    return _mm_mul_ps(_mm_add_ps(left, right), _mm_set1_ps(0.5f));
+}
+#endif
+
+static void FloatToS16Stereo(void* dest, const float* src, size_t frames)
+{
+    auto out = static_cast<int16_t*>(dest);
+    size_t samples = frames * 2, i = 0;
+#if defined(__SSE2__)
+    for (; i + 8 <= samples; i += 8) {
+        __m128i lo = QuantizeX4<16>(_mm_loadu_ps(src + i));
+        __m128i hi = QuantizeX4<16>(_mm_loadu_ps(src + i + 4));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packs_epi32(lo, hi));
+    }
+#endif
+    StereoFromFloatScalar<int16_t, 16>(out + i, src + i, samples - i);
+}
+
+static void FloatToS16Mono(void* dest, const float* src, size_t frames)
+{
+    auto out = static_cast<int16_t*>(dest);
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 8 <= frames; i += 8) {
+        __m128i lo = QuantizeX4<16>(MixX4(src + i * 2));
+        __m128i hi = QuantizeX4<16>(MixX4(src + i * 2 + 8));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packs_epi32(lo, hi));
+    }
+#endif
+    MonoFromFloatScalar<int16_t, 16>(out + i, src + i * 2, frames - i);
+}
+
+static void FloatToS24Stereo(void* dest, const float* src, size_t frames)
+{
+    auto out = static_cast<int32_t*>(dest);
+    size_t samples = frames * 2, i = 0;
+#if defined(__SSE2__)
+    for (; i + 4 <= samples; i += 4) {
+        _mm_storeu_si128((__m128i*)(out + i), QuantizeX4<24>(_mm_loadu_ps(src + i)));
+    }
+#endif
+    StereoFromFloatScalar<int32_t, 24>(out + i, src + i, samples - i);
+}
+
+static void FloatToS24Mono(void* dest, const float* src, size_t frames)
+{
+    auto out = static_cast<int32_t*>(dest);
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 4 <= frames; i += 4) {
+        _mm_storeu_si128((__m128i*)(out + i), QuantizeX4<24>(MixX4(src + i * 2)));
+    }
+#endif
+    MonoFromFloatScalar<int32_t, 24>(out + i, src + i * 2, frames - i);
+}
+
+FloatToPCMFn SelectFloatToPCM(int channels, int bitsPerSample)
+{
+    bool mono = channels < 2;
+    if (bitsPerSample > 16) {
+        return mono ? FloatToS24Mono : FloatToS24Stereo;
+    }
+    return mono ? FloatToS16Mono : FloatToS16Stereo;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+
+// Converts `frames` frames of signed PCM, as delivered by the SPORT (16-bit
+// words, or 24-bit samples in 32-bit words), to interleaved float stereo in
+// [-1, 1). Mono input is duplicated to both channels.
+using PCMToFloatFn = void (*)(float* dest, const void* src, size_t frames);
+
+// Picks the converter for one input format, using the widest instruction set
+// the host supports (AVX2, SSE2 or scalar). `channels` is 1 or 2.
+PCMToFloatFn SelectPCMToFloat(int channels, int bitsPerSample);
+
+// The reverse direction, for SPORT receive: interleaved float stereo to
+// signed PCM words (16-bit, or 24-bit samples sign-extended in 32-bit words),
+// rounded to nearest and saturated. Mono output is the average of L and R.
+using FloatToPCMFn = void (*)(void* dest, const float* src, size_t frames);
+
+FloatToPCMFn SelectFloatToPCM(int channels, int bitsPerSample);
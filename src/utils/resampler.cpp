@@ -0,0 +1,90 @@
+#include "resampler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+CubicResampler::CubicResampler(size_t maxPending)
+    : maxPending(std::max(maxPending, HISTORY + 1)), pending(this->maxPending * CHANNELS)
+{
+    Reset();
+}
+
+void CubicResampler::Reset()
+{
+    // One frame of silence before the first input frame
+    std::fill(pending.begin(), pending.begin() + CHANNELS, 0.0f);
+    frames = 1;
+    position = 1.0;
+}
+
+size_t CubicResampler::Push(const float* input, size_t count)
+{
+    size_t dropped = 0;
+    if (count > maxPending) {
+        dropped += count - maxPending;
+        input += dropped * CHANNELS;
+        count = maxPending;
+    }
+    if (frames + count > maxPending) {
+        size_t discard = frames + count - maxPending;
+        memmove(pending.data(), pending.data() + discard * CHANNELS, (frames - discard) * CHANNELS * sizeof(float));
+        frames -= discard;
+        position = std::max(1.0, position - discard);
+        dropped += discard;
+    }
+    memcpy(pending.data() + frames * CHANNELS, input, count * CHANNELS * sizeof(float));
+    frames += count;
+    return dropped;
+}
+
+size_t CubicResampler::Available(double step) const
+{
+    // Each output frame reads input frames floor(position) - 1 to + 2
+    double span = (double)frames - HISTORY + 1 - position;
+    return span > 0 ? (size_t)std::ceil(span / step) : 0;
+}
+
+size_t CubicResampler::Pull(float* output, size_t maxFrames, double step)
+{
+    size_t produced = 0;
+    double pos = position;
+    const float* data = pending.data();
+    while (produced < maxFrames) {
+        size_t i = (size_t)pos;
+        if (i + 2 >= frames) break;
+        float t = (float)(pos - i);
+        // Catmull-Rom weights of frames i - 1, i, i + 1, i + 2
+        float c0 = ((-0.5f * t + 1.0f) * t - 0.5f) * t;
+        float c1 = (1.5f * t - 2.5f) * t * t + 1.0f;
+        float c2 = ((-1.5f * t + 2.0f) * t + 0.5f) * t;
+        float c3 = (0.5f * t - 0.5f) * t * t;
+        const float* f = data + (i - 1) * CHANNELS;
+        float* out = output + produced * CHANNELS;
+#if defined(__SSE2__)
+        __m128 a = _mm_mul_ps(_mm_loadu_ps(f), _mm_set_ps(c1, c1, c0, c0));
+        __m128 b = _mm_mul_ps(_mm_loadu_ps(f + 4), _mm_set_ps(c3, c3, c2, c2));
+        __m128 s = _mm_add_ps(a, b);
+        s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        _mm_storel_pi((__m64*)out, s);
+#else
+        for (size_t c = 0; c < CHANNELS; c++) {
+            out[c] = c0 * f[c] + c1 * f[CHANNELS + c] + c2 * f[2 * CHANNELS + c] + c3 * f[3 * CHANNELS + c];
+        }
+#endif
+        produced++;
+        pos += step;
+    }
+
+    // Drop input that no later output frame can reach
+    size_t consumed = std::min((size_t)pos - 1, frames - 1);
+    if (consumed > 0) {
+        memmove(pending.data(), pending.data() + consumed * CHANNELS, (frames - consumed) * CHANNELS * sizeof(float));
+        frames -= consumed;
+        pos -= consumed;
+    }
+    position = pos;
+    return produced;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Streaming fractional resampler for interleaved float stereo, using 4-point
+// cubic Hermite interpolation. Input is queued with Push() and output pulled
+// with Pull() at a step (input frames per output frame) that may change
+// between calls, which lets a rate controller trim drift without clicks.
+class CubicResampler {
+public:
+    explicit CubicResampler(size_t maxPending);
+
+    // Queues `count` input frames. Frames beyond `maxPending` are dropped
+    // from the front of the queue and counted in the return value.
+    size_t Push(const float* input, size_t count);
+    // Writes up to `maxFrames` output frames advancing `step` input frames
+    // each, and returns the number written.
+    size_t Pull(float* output, size_t maxFrames, double step);
+    // Output frames Pull() can still produce at `step`.
+    size_t Available(double step) const;
+    void Reset();
+
+private:
+    static constexpr size_t CHANNELS = 2;
+    static constexpr size_t HISTORY = 3; // frames kept before/after the position
+
+    size_t maxPending;
+    std::vector<float> pending; // interleaved frames, pending[0] is position - 1
+    size_t frames = 0;          // frames in `pending`
+    double position = 1.0;      // fractional read position in `pending`
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+// Fixed-capacity FIFO for modelling hardware FIFOs. Storage is inline, so it
+// never allocates, and the bulk operations copy with at most two memcpy
+// calls. The interface follows std::queue for single elements.
+template <typename T, size_t Capacity>
+class RingBuffer {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+    static_assert(std::is_trivially_copyable<T>::value, "elements are moved with memcpy");
+
+public:
+    static constexpr size_t capacity() { return Capacity; }
+    size_t size() const { return count; }
+    size_t space() const { return Capacity - count; }
+    bool empty() const { return count == 0; }
+    bool full() const { return count == Capacity; }
+
+    void clear() {
+        head = 0;
+        count = 0;
+    }
+
+    // Returns false, dropping `value`, when full.
+    bool push(const T& value) {
+        if (full()) {
+            return false;
+        }
+        data[(head + count) & MASK] = value;
+        count++;
+        return true;
+    }
+
+    // Undefined when empty, as with std::queue.
+    T& front() { return data[head]; }
+    const T& front() const { return data[head]; }
+
+    void pop() {
+        if (count) {
+            head = (head + 1) & MASK;
+            count--;
+        }
+    }
+
+    // Appends up to `n` elements and returns how many fit.
+    size_t push_n(const T* source, size_t n) {
+        n = std::min(n, space());
+        size_t tail = (head + count) & MASK;
+        size_t first = std::min(n, Capacity - tail);
+        memcpy(data + tail, source, first * sizeof(T));
+        memcpy(data, source + first, (n - first) * sizeof(T));
+        count += n;
+        return n;
+    }
+
+    // Copies up to `n` elements from `offset` past the front without
+    // removing them, and returns how many were copied.
+    size_t peek(T* dest, size_t n, size_t offset = 0) const {
+        if (offset >= count) {
+            return 0;
+        }
+        n = std::min(n, count - offset);
+        size_t start = (head + offset) & MASK;
+        size_t first = std::min(n, Capacity - start);
+        memcpy(dest, data + start, first * sizeof(T));
+        memcpy(dest + first, data, (n - first) * sizeof(T));
+        return n;
+    }
+
+    // Removes up to `n` elements into `dest` and returns how many.
+    size_t pop_n(T* dest, size_t n) {
+        n = peek(dest, n);
+        head = (head + n) & MASK;
+        count -= n;
+        return n;
+    }
+
+private:
+    static constexpr size_t MASK = Capacity - 1;
+
+    T data[Capacity];
+    size_t head = 0;
+    size_t count = 0;
+};
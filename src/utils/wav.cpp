@@ -0,0 +1,117 @@
+#include "wav.h"
+#include "log.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+static constexpr uint16_t WAVE_FORMAT_PCM = 0x0001;
+static constexpr uint16_t WAVE_FORMAT_IEEE_FLOAT = 0x0003;
+static constexpr uint16_t WAVE_FORMAT_EXTENSIBLE = 0xFFFE;
+
+static uint32_t ReadLE(const uint8_t* p, int bytes)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= (uint32_t)p[i] << (8 * i);
+    }
+    return value;
+}
+
+static float DecodeSample(const uint8_t* p, uint16_t format, int bits)
+{
+    if (format == WAVE_FORMAT_IEEE_FLOAT) {
+        float value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+    switch (bits) {
+    case 8:
+        return ((int)p[0] - 128) / 128.0f; // 8-bit WAV is unsigned
+    case 16:
+        return (int16_t)ReadLE(p, 2) / 32768.0f;
+    case 24:
+        return ((int32_t)(ReadLE(p, 3) << 8) >> 8) / 8388608.0f;
+    default:
+        return (int32_t)ReadLE(p, 4) / 2147483648.0f;
+    }
+}
+
+bool LoadWav(const std::string& path, std::vector<float>& frames, uint32_t& sampleRate)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        LogError("Failed to open WAV file: %s", path.c_str());
+        return false;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (data.size() < 12 || memcmp(data.data(), "RIFF", 4) || memcmp(data.data() + 8, "WAVE", 4)) {
+        LogError("Not a RIFF/WAVE file: %s", path.c_str());
+        return false;
+    }
+
+    uint16_t format = 0, channels = 0, bits = 0;
+    const uint8_t* samples = nullptr;
+    size_t sampleBytes = 0;
+    for (size_t pos = 12; pos + 8 <= data.size();) {
+        const uint8_t* chunk = data.data() + pos;
+        size_t size = std::min<size_t>(ReadLE(chunk + 4, 4), data.size() - pos - 8);
+        if (!memcmp(chunk, "fmt ", 4) && size >= 16) {
+            format = ReadLE(chunk + 8, 2);
+            channels = ReadLE(chunk + 10, 2);
+            sampleRate = ReadLE(chunk + 12, 4);
+            bits = ReadLE(chunk + 22, 2);
+            if (format == WAVE_FORMAT_EXTENSIBLE && size >= 26) {
+                format = ReadLE(chunk + 32, 2); // first two bytes of the SubFormat GUID
+            }
+        } else if (!memcmp(chunk, "data", 4)) {
+            samples = chunk + 8;
+            sampleBytes = size;
+        }
+        pos += 8 + size + (size & 1); // chunks are word aligned
+    }
+
+    bool supported = (format == WAVE_FORMAT_PCM && (bits == 8 || bits == 16 || bits == 24 || bits == 32))
+                  || (format == WAVE_FORMAT_IEEE_FLOAT && bits == 32);
+    if (!supported || channels == 0 || sampleRate == 0 || !samples) {
+        LogError("Unsupported WAV file %s: format %d, %d channels, %d bits", path.c_str(), format, channels, bits);
+        return false;
+    }
+
+    size_t sampleSize = bits / 8;
+    size_t frameSize = sampleSize * channels;
+    size_t count = sampleBytes / frameSize;
+    frames.resize(count * 2);
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t* frame = samples + i * frameSize;
+        float left = DecodeSample(frame, format, bits);
+        float right = channels > 1 ? DecodeSample(frame + sampleSize, format, bits) : left;
+        frames[2 * i] = left;
+        frames[2 * i + 1] = right;
+    }
+    return true;
+}
+
+static void WriteLE(std::ostream& out, uint32_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++) {
+        out.put((char)(value >> (8 * i)));
+    }
+}
+
+void WriteWavHeader(std::ostream& out, int channels, uint32_t sampleRate, int bitsPerSample, uint32_t dataBytes)
+{
+    uint32_t blockAlign = channels * (bitsPerSample / 8);
+    out.write("RIFF", 4);
+    WriteLE(out, 36 + dataBytes, 4);
+    out.write("WAVEfmt ", 8);
+    WriteLE(out, 16, 4);
+    WriteLE(out, WAVE_FORMAT_PCM, 2);
+    WriteLE(out, channels, 2);
+    WriteLE(out, sampleRate, 4);
+    WriteLE(out, sampleRate * blockAlign, 4);
+    WriteLE(out, blockAlign, 2);
+    WriteLE(out, bitsPerSample, 2);
+    out.write("data", 4);
+    WriteLE(out, dataBytes, 4);
+}
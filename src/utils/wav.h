@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Loads a RIFF/WAVE file (8/16/24/32-bit PCM or 32-bit float, any channel
+// count) as interleaved float stereo. Mono is duplicated, extra channels are
+// dropped. Returns false and logs on error.
+bool LoadWav(const std::string& path, std::vector<float>& frames, uint32_t& sampleRate);
+
+// Writes a 44-byte PCM WAVE header for `dataBytes` bytes of sample data.
+// Writers emit it with a zero size first and rewrite it once the length is known.
+void WriteWavHeader(std::ostream& out, int channels, uint32_t sampleRate, int bitsPerSample, uint32_t dataBytes);
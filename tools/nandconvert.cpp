@@ -0,0 +1,173 @@
+#include "peripheral/nand_image.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Converts a Split NAND image (all data areas, then all OOB areas) to the
+// Interleaved layout, one range of blocks per thread.
+
+static constexpr u64 OOB_AREA_OFFSET = static_cast<u64>(NandImage::TOTAL_PAGES) * NandImage::PAGE_SIZE;
+static constexpr u64 DEVICE_SIZE = OOB_AREA_OFFSET + static_cast<u64>(NandImage::TOTAL_PAGES) * NandImage::OOB_SIZE;
+static constexpr u32 ERASED_BITMAP_SIZE = NandImage::TOTAL_BLOCKS / 8;
+static constexpr u32 BLOCK_TOTAL_SIZE = NandImage::PAGE_TOTAL_SIZE * NandImage::PAGES_PER_BLOCK;
+
+// Copies `length` bytes from `offset` of a source of `sourceSize` bytes;
+// bytes past its end read as erased, as the emulator fills them in
+static void CopyRange(u8* dest, const u8* source, u64 sourceSize, u64 offset, u32 length) {
+    u64 available = offset < sourceSize ? std::min<u64>(length, sourceSize - offset) : 0;
+    if (available) {
+        std::memcpy(dest, source + offset, available);
+    }
+    std::memset(dest + available, NandImage::ERASED_VALUE, length - available);
+}
+
+// Writes each block with one pwrite; writing through a mapping would let
+// the kernel allocate whole folios and fill in the holes of erased blocks
+static bool ConvertBlocks(int outputFd, const u8* input, u64 inputSize, const std::vector<u8>& erasedBlocks,
+                          u32 firstBlock, u32 endBlock) {
+    std::vector<u8> buffer(BLOCK_TOTAL_SIZE);
+    for (u32 block = firstBlock; block < endBlock; block++) {
+        if ((erasedBlocks[block / 8] >> (block % 8)) & 1) {
+            continue; // left as a hole
+        }
+        for (u32 i = 0; i < NandImage::PAGES_PER_BLOCK; i++) {
+            u32 page = block * NandImage::PAGES_PER_BLOCK + i;
+            u8* dest = buffer.data() + i * NandImage::PAGE_TOTAL_SIZE;
+            CopyRange(dest, input, inputSize, static_cast<u64>(page) * NandImage::PAGE_SIZE, NandImage::PAGE_SIZE);
+            CopyRange(dest + NandImage::PAGE_SIZE, input, inputSize,
+                      OOB_AREA_OFFSET + static_cast<u64>(page) * NandImage::OOB_SIZE, NandImage::OOB_SIZE);
+        }
+        u64 offset = NandImage::HEADER_SIZE + static_cast<u64>(block) * BLOCK_TOTAL_SIZE;
+        if (pwrite(outputFd, buffer.data(), buffer.size(), offset) != static_cast<ssize_t>(buffer.size())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Reads the input's erased block bitmap into `bitmap`, which stays with no
+// block erased if the input has none
+static bool ReadErasedBitmap(const std::string& path, std::vector<u8>& bitmap) {
+    bitmap.assign(ERASED_BITMAP_SIZE, 0);
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat info;
+    bool valid = fd >= 0 && fstat(fd, &info) == 0 && info.st_size == ERASED_BITMAP_SIZE &&
+                 pread(fd, bitmap.data(), bitmap.size(), 0) == static_cast<ssize_t>(bitmap.size());
+    if (!valid) {
+        std::fill(bitmap.begin(), bitmap.end(), 0);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    return valid;
+}
+
+static int Convert(const std::string& inputPath, const std::string& outputPath, unsigned threads) {
+    int inputFd = open(inputPath.c_str(), O_RDONLY);
+    struct stat info;
+    if (inputFd < 0 || fstat(inputFd, &info) != 0) {
+        std::cerr << "Error: Failed to open " << inputPath << std::endl;
+        return 1;
+    }
+    if (NandImage::DetectLayout(inputFd) == NandLayout::Interleaved) {
+        std::cerr << "Error: " << inputPath << " is already interleaved" << std::endl;
+        return 1;
+    }
+    if (std::filesystem::exists(outputPath)) {
+        std::cerr << "Error: Output already exists: " << outputPath << std::endl;
+        return 1;
+    }
+    // Holes read as 0x00, which would turn erased blocks into bad ones
+    std::vector<u8> erasedBlocks;
+    std::string inputBitmapPath = inputPath + NandImage::ERASED_BITMAP_SUFFIX;
+    if (!ReadErasedBitmap(inputBitmapPath, erasedBlocks) && NandImage::HasHoles(inputFd, info.st_size)) {
+        std::cerr << "Error: " << inputPath << " has holes but no valid " << inputBitmapPath << std::endl;
+        return 1;
+    }
+
+    // Let NandImage create the output with its header and an all-erased
+    // sidecar, so that an interrupted conversion reads as blank
+    {
+        NandImage image(outputPath);
+        if (!image.IsOpen()) {
+            return 1;
+        }
+    }
+
+    u64 inputSize = std::min<u64>(info.st_size, DEVICE_SIZE);
+    const u8* input = nullptr;
+    if (inputSize) {
+        void* mapping = mmap(nullptr, inputSize, PROT_READ, MAP_SHARED, inputFd, 0);
+        if (mapping == MAP_FAILED) {
+            std::cerr << "Error: Failed to map " << inputPath << std::endl;
+            return 1;
+        }
+        input = static_cast<const u8*>(mapping);
+    }
+    int outputFd = open(outputPath.c_str(), O_WRONLY);
+    if (outputFd < 0) {
+        std::cerr << "Error: Failed to open " << outputPath << std::endl;
+        return 1;
+    }
+
+    threads = std::clamp(threads, 1u, NandImage::TOTAL_BLOCKS);
+    std::vector<std::thread> workers;
+    std::atomic<bool> failed{false};
+    for (unsigned i = 0; i < threads; i++) {
+        u32 first = NandImage::TOTAL_BLOCKS * i / threads;
+        u32 end = NandImage::TOTAL_BLOCKS * (i + 1) / threads;
+        workers.emplace_back([&, first, end]() {
+            if (!ConvertBlocks(outputFd, input, inputSize, erasedBlocks, first, end)) {
+                failed = true;
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    if (input) {
+        munmap(const_cast<u8*>(input), inputSize);
+    }
+    close(inputFd);
+    bool synced = fsync(outputFd) == 0;
+    close(outputFd);
+    if (failed || !synced) {
+        std::cerr << "Error: Failed to write " << outputPath << std::endl;
+        return 1;
+    }
+
+    // Only now mark the converted blocks as holding data
+    std::string bitmapPath = outputPath + NandImage::ERASED_BITMAP_SUFFIX;
+    int bitmapFd = open(bitmapPath.c_str(), O_WRONLY);
+    bool written = bitmapFd >= 0 &&
+                   pwrite(bitmapFd, erasedBlocks.data(), erasedBlocks.size(), 0) == static_cast<ssize_t>(erasedBlocks.size()) &&
+                   fsync(bitmapFd) == 0;
+    if (bitmapFd >= 0) {
+        close(bitmapFd);
+    }
+    if (!written) {
+        std::cerr << "Error: Failed to write " << bitmapPath << std::endl;
+        return 1;
+    }
+    std::cout << "Converted " << inputPath << " to " << outputPath << " with " << threads << " threads" << std::endl;
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 3 && argc != 4) {
+        std::cerr << "Usage: " << argv[0] << " <split image> <output> [threads]" << std::endl;
+        return 1;
+    }
+    unsigned threads = argc == 4 ? std::atoi(argv[3]) : std::thread::hardware_concurrency();
+    return Convert(argv[1], argv[2], threads);
+}
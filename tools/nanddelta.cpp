@@ -0,0 +1,116 @@
+#include "peripheral/nand_image.h"
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Merged contents of one block of an overlay; erased pages are not present
+struct BlockCopy {
+    std::vector<u8> pages;
+    std::vector<bool> present;
+};
+
+static BlockCopy ReadBlock(const NandImage& image, u32 block) {
+    BlockCopy copy;
+    copy.pages.resize(NandImage::PAGES_PER_BLOCK * NandImage::PAGE_TOTAL_SIZE);
+    copy.present.resize(NandImage::PAGES_PER_BLOCK);
+    for (u32 i = 0; i < NandImage::PAGES_PER_BLOCK; i++) {
+        const u8* data;
+        const u8* oob;
+        image.Page(block * NandImage::PAGES_PER_BLOCK + i, data, oob);
+        if (data) {
+            u8* dest = copy.pages.data() + i * NandImage::PAGE_TOTAL_SIZE;
+            std::copy(data, data + NandImage::PAGE_SIZE, dest);
+            std::copy(oob, oob + NandImage::OOB_SIZE, dest + NandImage::PAGE_SIZE);
+            copy.present[i] = true;
+        }
+    }
+    return copy;
+}
+
+static void WriteBlock(NandImage& image, u32 block, const BlockCopy& copy) {
+    for (u32 i = 0; i < NandImage::PAGES_PER_BLOCK; i++) {
+        if (copy.present[i]) {
+            image.Program(block * NandImage::PAGES_PER_BLOCK + i, copy.pages.data() + i * NandImage::PAGE_TOTAL_SIZE);
+        }
+    }
+}
+
+static std::unique_ptr<NandImage> OpenOverlay(const std::string& base, const std::string& delta) {
+    if (!std::filesystem::exists(delta)) {
+        std::cerr << "Error: No such delta file: " << delta << std::endl;
+        return nullptr;
+    }
+    auto overlay = std::make_unique<NandImage>(delta, base);
+    if (!overlay->IsOpen()) {
+        std::cerr << "Error: Failed to open " << delta << " over " << base << std::endl;
+        return nullptr;
+    }
+    return overlay;
+}
+
+// Writes the merged view of the overlay to a new image
+static int Flatten(const std::string& base, const std::string& delta, const std::string& output) {
+    if (std::filesystem::exists(output)) {
+        std::cerr << "Error: Output already exists: " << output << std::endl;
+        return 1;
+    }
+    auto overlay = OpenOverlay(base, delta);
+    if (!overlay) {
+        return 1;
+    }
+    NandImage image(output);
+    if (!image.IsOpen()) {
+        return 1;
+    }
+    for (u32 block = 0; block < NandImage::TOTAL_BLOCKS; block++) {
+        WriteBlock(image, block, ReadBlock(*overlay, block));
+    }
+    image.Flush();
+    return 0;
+}
+
+// Applies the delta to the base image in place, then removes the delta
+static int Commit(const std::string& base, const std::string& delta) {
+    u32 committed = 0;
+    {
+        auto overlay = OpenOverlay(base, delta);
+        if (!overlay) {
+            return 1;
+        }
+        NandImage image(base);
+        if (!image.IsOpen()) {
+            return 1;
+        }
+        for (u32 block = 0; block < NandImage::TOTAL_BLOCKS; block++) {
+            if (!overlay->IsModified(block)) {
+                continue;
+            }
+            // Both views share the base pages, read before erasing
+            BlockCopy copy = ReadBlock(*overlay, block);
+            image.Erase(block);
+            WriteBlock(image, block, copy);
+            committed++;
+        }
+        image.Flush();
+    }
+    std::filesystem::remove(delta);
+    std::cout << "Committed " << committed << " blocks to " << base << std::endl;
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    std::string command = argc > 1 ? argv[1] : "";
+    if (command == "flatten" && argc == 5) {
+        return Flatten(argv[2], argv[3], argv[4]);
+    }
+    if (command == "commit" && argc == 4) {
+        return Commit(argv[2], argv[3]);
+    }
+    std::cerr << "Usage: " << argv[0] << " flatten <base> <delta> <output>" << std::endl;
+    std::cerr << "       " << argv[0] << " commit <base> <delta>" << std::endl;
+    std::cerr << "The base image must not be in use while committing." << std::endl;
+    return 1;
+}